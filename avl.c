@@ -2,25 +2,30 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include "avl.h"
+#include "runqueue.h"
 
 static inline size_t max(long long a, long long b)
 {
     return (a > b) ? a : b;
 } 
 
-// compare vmruntime + pid as vmruntime maybe same
-static int compare(long long v1, long long p1, long long v2, long long p2)
+static long long get_height(struct task *node) 
 {
-    if (v1 < v2) return -1;
-    if (v1 > v2) return +1;
-    if (p1 < p2) return -1;
-    if (p1 > p2) return +1;
-    return 0;
+    return !node ? 0 : node->height;
 }
 
-static long long get_height(struct task *node) 
+/*
+    Height and the subtree's earliest deadline, from the children's. Every
+    place that changes a node's children (the rotations and the way back
+    up from an insert or delete) ends with this, so min_deadline is
+    always valid for pick_deadline.
+*/
+static inline void update_node(struct task *node)
 {
-    return !node ? 0 : node->height;
+    node->height = 1 + max(get_height(node->left), get_height(node->right));
+    node->min_deadline = node->deadline;
+    if (node->left && node->left->min_deadline < node->min_deadline) node->min_deadline = node->left->min_deadline;
+    if (node->right && node->right->min_deadline < node->min_deadline) node->min_deadline = node->right->min_deadline;
 }
 
 static int balance_factor(struct task *node) 
@@ -29,6 +34,15 @@ static int balance_factor(struct task *node)
 
     return get_height(node->left) - get_height(node->right);
 }
+
+// points whatever held old (parent's child link, or the root) at new
+static inline void change_child(struct avl_root_cached *rq, struct task *parent, struct task *old, struct task *new)
+{
+    if (!parent) rq->root = new;
+    else if (parent->left == old) parent->left = new;
+    else parent->right = new;
+}
+
 /* Right rotate subtree rooted at x
  *
  *       x                 y
@@ -37,19 +51,26 @@ static int balance_factor(struct task *node)
  *    / \                   / \
  *   T1  T2                T2  T3
  */
-static struct task *right_rotate(struct task *node) 
+static struct task *right_rotate(struct avl_root_cached *rq, struct task *node) 
 {
     struct task *y  = node->left;
     struct task *T2 = y->right;
+    struct task *parent = node->parent;
 
     // Perform rotation, reversing the order will create a cycle !!
     node->left = T2;
+    if (T2) T2->parent = node;
     y->right   = node;
+    node->parent = y;
+    y->parent  = parent;
+    change_child(rq, parent, node, y);
 
-    // Update heights
-    node->height = 1 + max(get_height(node->left), get_height(node->right));
-    y->height    = 1 + max(get_height(y->left), get_height(y->right));
+    // Update heights and deadlines, node is below y now
+    update_node(node);
+    update_node(y);
 
+    rq->rotations++;
+    tp_fire(TP_ROTATION, node->pid, 1, 0);
     return y;
 }
 /* Left rotate subtree rooted at x
@@ -60,199 +81,519 @@ static struct task *right_rotate(struct task *node)
  *     / \              / \
  *    T2  T3           T1 T2
  */
-static struct task *left_rotate(struct task *node) 
+static struct task *left_rotate(struct avl_root_cached *rq, struct task *node) 
 {
     struct task *y  = node->right;
     struct task *T2 = y->left;
+    struct task *parent = node->parent;
 
     // Perform rotation, reversing the order will create a cycle !!
     node->right = T2;
+    if (T2) T2->parent = node;
     y->left     = node;
+    node->parent = y;
+    y->parent   = parent;
+    change_child(rq, parent, node, y);
 
-    // Update heights
-    node->height = 1 + max(get_height(node->left), get_height(node->right));
-    y->height    = 1 + max(get_height(y->left), get_height(y->right));
+    // Update heights and deadlines, node is below y now
+    update_node(node);
+    update_node(y);
 
+    rq->rotations++;
+    tp_fire(TP_ROTATION, node->pid, 0, 0);
     return y;
 }
 
-void avl_print_tree(struct task *root)
+/*
+    Walks up from node, whose children just changed, refreshing height and
+    min_deadline and rotating wherever a node is out of balance (LL / RR
+    single, LR / RL double). Stops at the first subtree that comes out with
+    the height and min_deadline it had before, nothing above it changes.
+    After an insert that is at most one rotation away, after a delete it
+    can go on up to the root.
+*/
+static void rebalance_up(struct avl_root_cached *rq, struct task *node)
 {
-    if (!root) return;
+    while (node)
+    {
+        long long height = node->height;
+        long long min_deadline = node->min_deadline;
+
+        update_node(node);
+
+        int bf_cur = balance_factor(node);
+        if (bf_cur > 1)
+        {
+            if (balance_factor(node->left) < 0) left_rotate(rq, node->left);    // LR
+            node = right_rotate(rq, node);
+        }
+        else if (bf_cur < -1)
+        {
+            if (balance_factor(node->right) > 0) right_rotate(rq, node->right); // RL
+            node = left_rotate(rq, node);
+        }
 
-    avl_print_tree(root->left);
-    #ifdef DEBUG
-    fprintf(stdout, "%lld %lld %lld\n", root->pid, root->vmruntime, root->remaining_time);
-    #endif
-    avl_print_tree(root->right);
+        if (node->height == height && node->min_deadline == min_deadline) return;
+        node = node->parent;
+    }
 }
 
 struct task *avl_find_min(struct task *root) 
 {
     if (!root) return NULL;
-    if (!root->left) return root;
 
-    return avl_find_min(root->left);
+    while (root->left) root = root->left;
+    return root;
 }
 
-struct task *avl_find_by_pid(struct task *root, long long pid) 
+// in-order successor: the min of the right subtree, or the first ancestor we are left of
+struct task *avl_next(struct task *node)
 {
-    struct task *stack[1024];
-    int top = 0;
-
-    if (root) stack[top++] = root;
+    if (node->right) return avl_find_min(node->right);
 
-    while (top > 0) {
-        struct task *cur = stack[--top];
+    while (node->parent && node == node->parent->right) node = node->parent;
+    return node->parent;
+}
 
-        if (cur->pid == pid)
-            return cur;
+void avl_insert_cached(struct avl_root_cached *rq, struct task *node)
+{
+    struct task *parent = NULL;
+    struct task **link = &rq->root;
+    char is_leftmost = 1;
 
-        if (cur->right) stack[top++] = cur->right;
-        if (cur->left)  stack[top++] = cur->left;
+    while (*link)
+    {
+        parent = *link;
+        if (task_compare(node, parent) < 0) link = &parent->left;
+        else
+        {
+            link = &parent->right;
+            is_leftmost = 0;
+        }
     }
 
-    return NULL;
+    node->left = node->right = NULL;
+    node->parent = parent;
+    node->height = 1;
+    node->min_deadline = node->deadline;
+    *link = node;
+
+    if (is_leftmost) rq->leftmost = node;
+    rebalance_up(rq, parent);
 }
 
-struct task *avl_insert(struct task *root, struct task *node) 
+/*
+    Unlinks node where it is, no search. A node with two children is
+    replaced by its in-order successor, spliced in with its own links
+    rather than by copying its payload over: callers (pid index, timer
+    wheel, cpu->curr) hold task pointers. The successor takes over the
+    old height so the walk up compares against what that position had.
+    Its min_deadline may still count node's deadline if the walk stops
+    below it, so it gets a walk of its own.
+*/
+void avl_delete_cached(struct avl_root_cached *rq, struct task *node)
 {
-    if (!root) 
-    {  
-        node->height = 1;
-        node->left = node->right = NULL;
-        return node;
-    }
+    struct task *parent = node->parent;
+    struct task *fix;
+
+    if (node == rq->leftmost) rq->leftmost = avl_next(node);
 
-    int cmp  = compare(node->vmruntime, node->pid, root->vmruntime, root->pid);
-    if (cmp < 0) root->left = avl_insert(root->left, node);
-    else if (cmp > 0) root->right = avl_insert(root->right, node);
-
-    root->height = 1 + max(get_height(root->left), get_height(root->right));
-
-    int bf_cur   = balance_factor(root);
-
-    /* 
-                x
-            y
-        z
-    */
-    /*
-            x
-        y
-            z
-    */
-    if (bf_cur > 1 && root->left) // LL
+    if (!node->left || !node->right)
     {
-        if (compare(node->vmruntime, node->pid, root->left->vmruntime, root->left->pid) < 0)
-            root = right_rotate(root);
-        else if (compare(node->vmruntime, node->pid, root->left->vmruntime, root->left->pid) > 0)
-        {
-            root->left = left_rotate(root->left);
-            root = right_rotate(root);
-        }
+        struct task *child = node->left ? node->left : node->right;
+
+        if (child) child->parent = parent;
+        change_child(rq, parent, node, child);
+        fix = parent;
     }
-    /*
-        x
-            y
-                z
-    */
-    /*
-        x
-            y
-        z
-    */
-    else if (bf_cur < -1 && root->right) // RR
+    else
     {
-        if (compare(node->vmruntime, node->pid, root->right->vmruntime, root->right->pid) > 0)
-        root = left_rotate(root);
-        else if (compare(node->vmruntime, node->pid, root->right->vmruntime, root->right->pid) < 0)
+        struct task *successor = avl_find_min(node->right);
+        struct task *below = NULL;
+
+        if (successor != node->right)
         {
-            root->right = right_rotate(root->right);
-            root = left_rotate(root);
+            below = successor->parent;
+            below->left = successor->right;
+            if (successor->right) successor->right->parent = below;
+            successor->right = node->right;
+            node->right->parent = successor;
         }
+
+        successor->left = node->left;
+        node->left->parent = successor;
+        successor->parent = parent;
+        successor->height = node->height;
+        successor->min_deadline = node->min_deadline;
+        change_child(rq, parent, node, successor);
+
+        // the walk from below can stop short of successor, which still
+        // carries node's min_deadline, so that one is walked again
+        if (below) rebalance_up(rq, below);
+        fix = successor;
+    }
+
+    rebalance_up(rq, fix);
+}
+
+/*
+    Re-keys a queued node. A growing key that still sorts before the
+    successor leaves the tree shape valid, so it is rewritten in place
+    without any rotations and the leftmost cache stays put. Otherwise it
+    is a delete + insert.
+*/
+void avl_update_key_cached(struct avl_root_cached *rq, struct task *node, long long vmruntime)
+{
+    struct task *next = avl_next(node);
+
+    if (vmruntime >= node->vmruntime &&
+        (!next || task_key_compare(vmruntime, node->pid, next->vmruntime, next->pid) < 0))
+    {
+        node->vmruntime = vmruntime;
+        rebalance_up(rq, node);     // the caller may have moved its deadline
+        return;
+    }
+
+    avl_delete_cached(rq, node);
+    node->vmruntime = vmruntime;
+    avl_insert_cached(rq, node);
+}
+
+/*
+    Bulk insert. batch is n tasks linked through ->right. Inserting them
+    one by one costs n descents and up to n rotations. A batch that
+    arrives in key order, like tasks started at the same time and placed
+    at the same vruntime in pid order, usually also falls between two
+    neighbours in the tree. Then it is built into a balanced tree of its
+    own and joined in: the tree is split at the batch (split_at), and the
+    three parts are put back together with two AVL joins, O(n + log
+    nr_queued) however big either side is. Otherwise, once the batch is
+    four times the tree or more, the tree is flattened into a sorted list,
+    the (sorted) batch merged in, and a balanced tree built back from the
+    list in one in-order pass: O(n + nr_queued). The built trees are
+    complete but for their last level, so they are valid AVL trees. A
+    smaller, scattered batch stays with the inserts.
+*/
+static struct task *merge_lists(struct task *a, struct task *b)
+{
+    struct task head = { .right = NULL };
+    struct task *tail = &head;
+
+    while (a && b)
+    {
+        if (task_compare(a, b) < 0) { tail->right = a; a = a->right; }
+        else { tail->right = b; b = b->right; }
+        tail = tail->right;
     }
+    tail->right = a ? a : b;
+
+    return head.right;
+}
+
+static struct task *sort_list(struct task *list, long long n)
+{
+    if (n < 2) return list;
+
+    struct task *mid = list;
+    for (long long i = 1; i < n / 2; i++) mid = mid->right;
+    struct task *second = mid->right;
+    mid->right = NULL;
 
+    return merge_lists(sort_list(list, n / 2), sort_list(second, n - n / 2));
+}
+
+// appends the subtree in order to *tail through ->right
+static void flatten(struct task *root, struct task ***tail)
+{
+    if (!root) return;
+
+    flatten(root->left, tail);
+    **tail = root;
+    *tail = &root->right;
+    flatten(root->right, tail);
+}
+
+// the first n nodes of *list as a balanced tree under parent, *list moves past them
+static struct task *build_balanced(struct task **list, long long n, struct task *parent)
+{
+    if (n == 0) return NULL;
+
+    struct task *left = build_balanced(list, n / 2, NULL);
+    struct task *root = *list;
+    *list = root->right;
+
+    root->parent = parent;
+    root->left = left;
+    if (left) left->parent = root;
+    root->right = build_balanced(list, n - n / 2 - 1, root);
+    update_node(root);
     return root;
 }
 
-struct task *avl_delete(struct task *root, struct task **bubbled_node, long long pid, long long vmruntime) 
+/*
+    Joins left, mid and right (every key in that order) into one tree and
+    returns its root. The taller side's inner spine is walked down to the
+    first subtree no more than one level taller than the other side, mid
+    takes that subtree's place with the other side as its second child,
+    and the way back up is rebalanced like after an insert: O(difference
+    in height). The parts come in detached, with NULL parents.
+*/
+static struct task *join(struct avl_root_cached *rq, struct task *left, struct task *mid, struct task *right)
 {
-    if (root == NULL) return root;
+    long long hl = get_height(left), hr = get_height(right);
+    struct avl_root_cached part = { NULL, NULL, 0 };
+    struct task *parent = NULL, *sub;
 
-    struct task *ret = NULL;
-    struct task *replace = NULL;
+    if (hl > hr + 1)
+    {
+        part.root = sub = left;
+        while (get_height(sub) > hr + 1) { parent = sub; sub = sub->right; }
+        left = sub;
+    }
+    else if (hr > hl + 1)
+    {
+        part.root = sub = right;
+        while (get_height(sub) > hl + 1) { parent = sub; sub = sub->left; }
+        right = sub;
+    }
 
-    int cmp = compare(vmruntime, pid, root->vmruntime, root->pid);
-    if (cmp < 0) root->left = avl_delete(root->left, bubbled_node, pid, vmruntime);
-    else if (cmp > 0) root->right = avl_delete(root->right, bubbled_node, pid, vmruntime);
+    mid->left = left;
+    mid->right = right;
+    mid->parent = parent;
+    if (left) left->parent = mid;
+    if (right) right->parent = mid;
+    update_node(mid);
+    if (!parent) return mid;
 
-    if (!root) return NULL;
+    if (parent->right == sub) parent->right = mid;
+    else parent->left = mid;
+    rebalance_up(&part, parent);
+
+    rq->rotations += part.rotations;
+    return part.root;
+}
+
+/*
+    Splits the tree at key: *left gets every node before it, *right every
+    node after it. The walk down collects the nodes it passes, and from
+    the bottom up each one is joined to the part gathered below it on its
+    side. The joins telescope to O(log n) in all.
+*/
+static void split_at(struct avl_root_cached *rq, const struct task *key, struct task **left, struct task **right)
+{
+    struct task *path[AVL_MAX_HEIGHT];
+    int depth = 0;
+
+    for (struct task *node = rq->root; node; node = task_compare(node, key) < 0 ? node->right : node->left)
+    {
+        path[depth++] = node;
+    }
 
-    if (cmp == 0)
+    *left = *right = NULL;
+    while (depth--)
     {
-        if (root->left && root->right) 
+        struct task *node = path[depth];
+
+        if (task_compare(node, key) < 0)
         {
-            replace = avl_find_min(root->right);
-            
-            root->pid = replace->pid;
-            root->vmruntime = replace->vmruntime;
-            root->remaining_time = replace->remaining_time;
-
-            root->right = avl_delete(root->right, bubbled_node, replace->pid, replace->vmruntime);
-        } 
-        else if (root->left) 
+            struct task *sub = node->left;
+            if (sub) sub->parent = NULL;
+            *left = join(rq, sub, node, *left);
+        }
+        else
         {
-            replace = root->left;
-            *bubbled_node = root;
-            root = replace;
-        } 
-        else if (root->right) 
+            struct task *sub = node->right;
+            if (sub) sub->parent = NULL;
+            *right = join(rq, *right, node, sub);
+        }
+    }
+}
+
+// the first queued node after key, NULL if there is none
+static struct task *lower_bound_after(struct task *root, const struct task *key)
+{
+    struct task *after = NULL;
+
+    while (root)
+    {
+        if (task_compare(root, key) > 0)
         {
-            replace = root->right;
-            *bubbled_node = root;
-            root = replace;
-        } 
+            after = root;
+            root = root->left;
+        }
         else
         {
-            *bubbled_node = root;
-            return NULL;
+            root = root->right;
         }
     }
 
-    root->height = 1 + max(get_height(root->left), get_height(root->right));
+    return after;
+}
 
-    int bf_cur   = balance_factor(root);
-    int bf_left  = balance_factor(root->left);
-    int bf_right = balance_factor(root->right);
-    
-    // LL
-    if (bf_cur > 1 && bf_left >= 0) 
+void avl_insert_batch_cached(struct avl_root_cached *rq, struct task *batch, long long n, long long nr_queued)
+{
+    struct task *last = batch;
+    while (last->right && task_compare(last, last->right) < 0) last = last->right;
+    int sorted = !last->right;
+
+    if (sorted && n >= 2)
     {
-        // Right ROtate
-        root = right_rotate(root);
-    } 
-    else if (bf_cur < -1 && bf_right <= 0) 
-    { // RR
-        // Left Rotate
-        root = left_rotate(root);
-    } 
-    else if (bf_cur > 1 && bf_left < 0 && root->left) 
-    { // LR
-        // Left Rotate on Left child
-        root->left = left_rotate(root->left);
-        // Update Left child
-        // Right Rotate on cur
-        root = right_rotate(root);
-    } 
-    else if (bf_cur < -1 && bf_right > 0 && root->right) 
-    { // RL
-        // Right Rotate on right child
-        root->right = right_rotate(root->right);
-        // Update Right child
-        // Left Rotate on cur
-        root = left_rotate(root);
+        struct task *after = lower_bound_after(rq->root, batch);
+
+        if (!after || task_compare(last, after) < 0)
+        {
+            struct task *left, *right;
+            struct task *list = batch->right;
+            struct task *inner = build_balanced(&list, n - 2, NULL);
+
+            split_at(rq, batch, &left, &right);
+            rq->root = join(rq, join(rq, left, batch, inner), last, right);
+            if (!rq->leftmost || task_compare(batch, rq->leftmost) < 0) rq->leftmost = batch;
+            return;
+        }
     }
 
-    return root;
-}
\ No newline at end of file
+    if (n < 4 * nr_queued)
+    {
+        while (batch)
+        {
+            struct task *next = batch->right;
+            avl_insert_cached(rq, batch);
+            batch = next;
+        }
+        return;
+    }
+
+    if (!sorted) batch = sort_list(batch, n);
+
+    struct task *queued = NULL;
+    struct task **tail = &queued;
+    flatten(rq->root, &tail);
+    *tail = NULL;
+
+    struct task *list = merge_lists(queued, batch);
+    rq->leftmost = list;
+    rq->root = build_balanced(&list, n + nr_queued, NULL);
+}
+
+/*
+    EEVDF pick: among the nodes with vmruntime <= vruntime (eligible), the
+    one with the earliest deadline, ties to the smaller key. The tree is
+    ordered by vmruntime, so on the way down an eligible node brings its
+    whole left subtree with it, and that subtree's min_deadline says
+    whether anything in it beats the best node so far. One descent finds
+    the best node on the path and the best eligible left subtree, a second
+    one follows min_deadline down into that subtree. O(log n).
+*/
+static inline int deadline_before(struct task *a, struct task *b)
+{
+    if (a->deadline != b->deadline) return a->deadline < b->deadline;
+    return task_compare(a, b) < 0;
+}
+
+struct task *avl_pick_deadline(struct task *root, long long vruntime)
+{
+    struct task *best = NULL;
+    struct task *best_left = NULL;
+
+    for (struct task *node = root; node; )
+    {
+        if (node->vmruntime > vruntime)
+        {
+            node = node->left;
+            continue;
+        }
+
+        if (!best || deadline_before(node, best)) best = node;
+        if (node->left && (!best_left || node->left->min_deadline < best_left->min_deadline)) best_left = node->left;
+        node = node->right;
+    }
+
+    if (!best_left || best_left->min_deadline > best->deadline) return best;
+
+    // the leftmost node holding the subtree's min_deadline
+    struct task *node = best_left;
+    while (node->deadline != best_left->min_deadline || (node->left && node->left->min_deadline == best_left->min_deadline))
+    {
+        node = node->left && node->left->min_deadline == best_left->min_deadline ? node->left : node->right;
+    }
+
+    return deadline_before(node, best) ? node : best;
+}
+
+static int avl_rq_init(struct run_queue *rq)
+{
+    rq->avl.root = rq->avl.leftmost = NULL;
+    rq->avl.rotations = 0;
+    return 0;
+}
+
+static void avl_rq_insert(struct run_queue *rq, struct task *t)
+{
+    avl_insert_cached(&rq->avl, t);
+}
+
+static void avl_rq_remove(struct run_queue *rq, struct task *t)
+{
+    avl_delete_cached(&rq->avl, t);
+}
+
+static void avl_rq_insert_batch(struct run_queue *rq, struct task *batch, long long n)
+{
+    avl_insert_batch_cached(&rq->avl, batch, n, rq->nr_running - n);
+}
+
+static struct task *avl_rq_peek_min(struct run_queue *rq)
+{
+    return avl_first_cached(&rq->avl);
+}
+
+static struct task *avl_rq_pop_min(struct run_queue *rq)
+{
+    struct task *t = avl_first_cached(&rq->avl);
+    if (t) avl_delete_cached(&rq->avl, t);
+    return t;
+}
+
+static void avl_rq_update(struct run_queue *rq, struct task *t, long long vruntime)
+{
+    avl_update_key_cached(&rq->avl, t, vruntime);
+}
+
+static struct task *avl_rq_pick_deadline(struct run_queue *rq, long long vruntime)
+{
+    return avl_pick_deadline(rq->avl.root, vruntime);
+}
+
+static struct task *avl_rq_next(struct run_queue *rq, struct task *t)
+{
+    return avl_next(t);
+}
+
+static unsigned long long avl_rq_restructures(struct run_queue *rq)
+{
+    return rq->avl.rotations;
+}
+
+static void avl_rq_visit(struct run_queue *rq, struct rq_visitor *v)
+{
+    v->ptr(v, &rq->avl.root);
+    v->ptr(v, &rq->avl.leftmost);
+    v->word(v, &rq->avl.rotations);
+}
+
+const struct rq_ops avl_rq_ops = {
+    .name         = "avl",
+    .init         = avl_rq_init,
+    .destroy      = NULL,
+    .insert       = avl_rq_insert,
+    .remove       = avl_rq_remove,
+    .insert_batch = avl_rq_insert_batch,
+    .peek_min     = avl_rq_peek_min,
+    .pop_min      = avl_rq_pop_min,
+    .update       = avl_rq_update,
+    .next         = avl_rq_next,
+    .pick_deadline = avl_rq_pick_deadline,
+    .restructures = avl_rq_restructures,
+    .visit        = avl_rq_visit,
+};
@@ -1,22 +1,33 @@
-
 #ifndef _AVL_H
 #define _AVL_H
-#include "map.h"
-struct task 
+#include <stdio.h>
+#include "task.h"
+
+#define AVL_MAX_HEIGHT      96      // more than 2^64 nodes would take
+
+/*
+    Run queue root that also caches its leftmost node, like the kernel's
+    rb_root_cached: pick-next is a pointer load instead of a walk down the
+    left spine.
+*/
+struct avl_root_cached
 {
-    long long vmruntime;
-    long long remaining_time;
-    long long pid;
-    long long height;
-    struct task *left;
-    struct task *right;
+    struct task *root;
+    struct task *leftmost;
+    unsigned long long rotations;
 };
 
-
-void avl_print_tree(struct task *root);
 struct task *avl_find_min(struct task *root);
-struct task *avl_insert(struct task *root, struct task *node);
-struct task *avl_delete(struct task *root, struct task **bubbled_node, long long pid, long long vmruntime) ;
-struct task *avl_find_by_pid(struct task *root, long long pid);
+void avl_insert_cached(struct avl_root_cached *rq, struct task *node);
+void avl_insert_batch_cached(struct avl_root_cached *rq, struct task *batch, long long n, long long nr_queued);
+void avl_delete_cached(struct avl_root_cached *rq, struct task *node);
+struct task *avl_next(struct task *node);
+void avl_update_key_cached(struct avl_root_cached *rq, struct task *node, long long vmruntime);
+struct task *avl_pick_deadline(struct task *root, long long vruntime);
+
+static inline struct task *avl_first_cached(struct avl_root_cached *rq)
+{
+    return rq->leftmost;
+}
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,286 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "batch.h"
+
+#define MAX_JOB_ARGS    64
+
+struct batch_job
+{
+    char *line;                 // owns the strings argv points into
+    int argc;
+    char *argv[MAX_JOB_ARGS];
+    const char *input;
+    char *output;
+    struct scheduler config;
+
+    // filled in by the worker
+    int status;
+    size_t sim_time;
+    unsigned long long nr_events;
+    unsigned long long nr_migrations;
+    unsigned long long restructures;
+    double wall_ms;
+};
+
+struct batch_pool
+{
+    struct batch_job *jobs;
+    size_t nr_jobs;
+    size_t next_job;
+    pthread_mutex_t lock;
+};
+
+static double now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+// split line in place and apply its options over defaults
+static int parse_job(struct batch_job *job, const struct scheduler *defaults)
+{
+    char *save = NULL;
+
+    job->argc = 0;
+    for (char *tok = strtok_r(job->line, " \t\r\n", &save); tok; tok = strtok_r(NULL, " \t\r\n", &save))
+    {
+        if (job->argc == MAX_JOB_ARGS) return -1;
+        job->argv[job->argc++] = tok;
+    }
+
+    job->input = job->argv[0];
+    job->config = *defaults;
+
+    int i = 1;
+    if (i < job->argc && job->argv[i][0] != '-')
+    {
+        job->output = strdup(job->argv[i++]);
+    }
+    else
+    {
+        job->output = malloc(strlen(job->input) + sizeof(".out"));
+        if (job->output) sprintf(job->output, "%s.out", job->input);
+    }
+    if (!job->output) return -1;
+
+    for (; i < job->argc; i++)
+    {
+        if (sched_parse_option(&job->config, job->argc, job->argv, &i) <= 0) return -1;
+    }
+
+    return 0;
+}
+
+static int load_jobs(const char *jobs_file, const struct scheduler *defaults,
+    struct batch_job **jobs, size_t *nr_jobs)
+{
+    FILE *f = fopen(jobs_file, "r");
+    if (!f) return -1;
+
+    char *line = NULL;
+    size_t cap = 0, size = 0;
+    long lineno = 0;
+    int ret = 0;
+
+    *jobs = NULL;
+    *nr_jobs = 0;
+
+    while (getline(&line, &cap, f) != -1)
+    {
+        lineno++;
+        char *p = line + strspn(line, " \t\r\n");
+        if (*p == '\0' || *p == '#') continue;
+
+        if (*nr_jobs == size)
+        {
+            size_t new_size = size ? size * 2 : 16;
+            struct batch_job *grown = realloc(*jobs, new_size * sizeof(struct batch_job));
+            if (!grown)
+            {
+                ret = -1;
+                break;
+            }
+            *jobs = grown;
+            size = new_size;
+        }
+
+        struct batch_job *job = &(*jobs)[*nr_jobs];
+        memset(job, 0, sizeof(*job));
+        job->line = strdup(p);
+        (*nr_jobs)++;
+
+        if (!job->line || parse_job(job, defaults) < 0)
+        {
+            fprintf(stderr, "%s:%ld: bad job line\n", jobs_file, lineno);
+            ret = -1;
+            break;
+        }
+    }
+
+    free(line);
+    fclose(f);
+    return ret;
+}
+
+static void run_job(struct batch_job *job)
+{
+    struct scheduler s = job->config;
+    double start = now_ms();
+
+    job->status = -1;
+
+    struct trace_reader trace;
+    if (trace_open(&trace, job->input) < 0) return;
+
+    FILE *out = fopen(job->output, "w");
+    if (!out)
+    {
+        trace_close(&trace);
+        return;
+    }
+
+    // histograms go next to the log unless the job names a file
+    char *hist_path = NULL;
+    if (s.hist_format && !s.hist_path)
+    {
+        hist_path = malloc(strlen(job->output) + sizeof(".hist"));
+        if (hist_path) sprintf(hist_path, "%s.hist", job->output);
+        s.hist_path = hist_path;
+    }
+
+    if (sched_init(&s, &trace, out) == 0)
+    {
+        sched_run(&s);
+        sched_print_stats(&s, out);
+
+        job->status = 0;
+        job->sim_time = s.sim_time;
+        job->nr_events = s.nr_events;
+        job->nr_migrations = s.nr_migrations;
+        job->restructures = sched_restructures(&s);
+    }
+
+    sched_destroy(&s);
+    free(hist_path);
+    trace_close(&trace);
+    if (fclose(out) != 0) job->status = -1;
+
+    job->wall_ms = now_ms() - start;
+}
+
+static void *batch_worker(void *arg)
+{
+    struct batch_pool *pool = arg;
+
+    for (;;)
+    {
+        pthread_mutex_lock(&pool->lock);
+        size_t idx = pool->next_job++;
+        pthread_mutex_unlock(&pool->lock);
+
+        if (idx >= pool->nr_jobs) break;
+        run_job(&pool->jobs[idx]);
+    }
+
+    return NULL;
+}
+
+static void print_summary(struct batch_job *jobs, size_t nr_jobs, int nr_threads, double wall_ms)
+{
+    unsigned long long events = 0, migrations = 0;
+    size_t failed = 0;
+
+    fprintf(stdout, "%-4s %-8s %-4s %10s %10s %10s %14s %10s  %s\n",
+        "job", "rq", "cpus", "sim_time", "events", "migrations", "restructures", "wall_ms", "input");
+
+    for (size_t i = 0; i < nr_jobs; i++)
+    {
+        struct batch_job *job = &jobs[i];
+
+        if (job->status < 0)
+        {
+            failed++;
+            fprintf(stdout, "%-4zu FAILED %s\n", i, job->input);
+            continue;
+        }
+
+        events += job->nr_events;
+        migrations += job->nr_migrations;
+        fprintf(stdout, "%-4zu %-8s %-4d %10zu %10llu %10llu %14llu %10.2f  %s\n",
+            i, job->config.rq_ops->name, job->config.nr_cpus, job->sim_time, job->nr_events,
+            job->nr_migrations, job->restructures, job->wall_ms, job->input);
+    }
+
+    fprintf(stdout, "batch: %zu jobs, %zu failed, %d threads, events=%llu migrations=%llu, %.2f ms (%.0f events/s)\n",
+        nr_jobs, failed, nr_threads, events, migrations, wall_ms,
+        wall_ms > 0 ? events / (wall_ms / 1e3) : 0.0);
+}
+
+static void free_jobs(struct batch_job *jobs, size_t nr_jobs)
+{
+    for (size_t i = 0; i < nr_jobs; i++)
+    {
+        free(jobs[i].line);
+        free(jobs[i].output);
+    }
+    free(jobs);
+}
+
+int batch_run(const char *jobs_file, int nr_threads, const struct scheduler *defaults)
+{
+    struct batch_pool pool = { .next_job = 0 };
+
+    if (load_jobs(jobs_file, defaults, &pool.jobs, &pool.nr_jobs) < 0)
+    {
+        #ifdef DEBUG
+        fprintf(stderr, "cant load jobs from %s\n", jobs_file);
+        #endif
+        free_jobs(pool.jobs, pool.nr_jobs);
+        return -1;
+    }
+
+    if (nr_threads <= 0)
+    {
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        nr_threads = online > 0 ? (int)online : 1;
+    }
+    if ((size_t)nr_threads > pool.nr_jobs) nr_threads = pool.nr_jobs ? (int)pool.nr_jobs : 1;
+
+    pthread_t *threads = calloc(nr_threads, sizeof(pthread_t));
+    if (!threads)
+    {
+        free_jobs(pool.jobs, pool.nr_jobs);
+        return -1;
+    }
+
+    pthread_mutex_init(&pool.lock, NULL);
+    double start = now_ms();
+
+    int started = 0;
+    for (; started < nr_threads; started++)
+    {
+        if (pthread_create(&threads[started], NULL, batch_worker, &pool) != 0) break;
+    }
+    // if no worker could be started, do the work on this thread
+    if (started == 0) batch_worker(&pool);
+
+    for (int i = 0; i < started; i++) pthread_join(threads[i], NULL);
+
+    print_summary(pool.jobs, pool.nr_jobs, started ? started : 1, now_ms() - start);
+
+    int ret = 0;
+    for (size_t i = 0; i < pool.nr_jobs; i++)
+    {
+        if (pool.jobs[i].status < 0) ret = -1;
+    }
+
+    pthread_mutex_destroy(&pool.lock);
+    free(threads);
+    free_jobs(pool.jobs, pool.nr_jobs);
+    return ret;
+}
@@ -0,0 +1,18 @@
+#ifndef _BATCH_H
+#define _BATCH_H
+#include "scheduler.h"
+
+/*
+    Batch mode: every line of jobs_file is one simulation,
+
+        INPUT [OUTPUT] [option ...]
+
+    run on a pool of nr_threads workers (0 = one per online CPU). Options
+    are the simulator's own (-rq, -map, -cpus, ...) and apply on top of
+    defaults. OUTPUT defaults to INPUT.out. Blank lines and lines starting
+    with '#' are skipped. A summary of every job is printed to stdout once
+    all of them are done.
+*/
+int batch_run(const char *jobs_file, int nr_threads, const struct scheduler *defaults);
+
+#endif
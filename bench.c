@@ -0,0 +1,239 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/resource.h>
+#include "scheduler.h"
+
+/*
+    Throughput benchmark for the simulator loop.
+
+    Replays a trace (see workload_gen.c) with the event log going to
+    /dev/null and reports events/sec and slices/sec. It then times the
+    run-queue operations of every backend, and the pid map, at the peak
+    task population the trace reached. Peak RSS is read right after the
+    simulation, so it is the simulator's alone.
+
+    gcc -O2 -o bench bench.c scheduler.c policy.c checkpoint.c timer.c trace.c output.c tracepoint.c histogram.c pipeline.c spsc.c runqueue.c avl.c cavl.c rbtree.c pheap.c bucketq.c map.c swissmap.c slab.c -lpthread
+    ./bench -i trace.bin [-rq NAME] [-map linear|swiss] [-cpus N] [-out FORMAT] [-pop N] [-ops N]
+*/
+
+static const struct rq_ops *backends[] = {
+    &avl_rq_ops, &cavl_rq_ops, &rb_rq_ops, &pheap_rq_ops, &bucketq_rq_ops,
+};
+
+static unsigned long long rng_state = 0x2545F4914F6CDD1DULL;
+
+static unsigned long long xorshift64(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static int bench_sim(struct scheduler *s, const char *input)
+{
+    struct trace_reader trace;
+    FILE *out = fopen("/dev/null", "w");
+
+    if (!out || trace_open(&trace, input) < 0)
+    {
+        fprintf(stderr, "cant open %s\n", input);
+        if (out) fclose(out);
+        return -1;
+    }
+
+    double t0 = now_ns();
+    int ret = sched_init(s, &trace, out);
+    if (ret == 0) sched_run(s);
+    double t1 = now_ns();
+
+    if (ret == 0)
+    {
+        double secs = (t1 - t0) / 1e9;
+        printf("sim: rq=%s map=%s cpus=%d\n", s->rq_ops->name,
+            s->map_mode == MAP_SWISS ? "swiss" : "linear", s->nr_cpus);
+        printf("  events=%llu slices=%llu peak_tasks=%zu sim_time=%zu ms\n",
+            s->nr_events, s->nr_slices, s->max_tasks, s->sim_time);
+        printf("  wall=%.1f ms  %.0f events/s  %.0f slices/s  %.1f ns/event\n",
+            secs * 1e3, s->nr_events / secs, s->nr_slices / secs,
+            s->nr_events ? (t1 - t0) / s->nr_events : 0.0);
+
+        // before the microbenchmarks below allocate anything
+        struct rusage ru;
+        getrusage(RUSAGE_SELF, &ru);
+        printf("  peak rss: %ld KiB\n", ru.ru_maxrss);
+    }
+    else
+    {
+        fprintf(stderr, "cant init simulation\n");
+    }
+
+    trace_close(&trace);
+    fclose(out);
+    return ret;
+}
+
+/*
+    insert: fill an empty queue. pop: drain it with pop_min, i.e. pick-next.
+    remove: unlink tasks in random order. churn: the steady state of the
+    simulator, pop the leftmost and requeue it one slice further right.
+*/
+static void bench_rq(const struct rq_ops *ops, struct task *tasks, long long pop, long long nr_ops)
+{
+    struct rq_pool pool = {0};
+    struct run_queue rq;
+    long long *order = malloc(pop * sizeof(long long));
+
+    if (!order || rq_pool_init(&pool, ops) < 0 || rq_init(&rq, ops, &pool) < 0)
+    {
+        fprintf(stderr, "%s: init failed\n", ops->name);
+        rq_pool_destroy(&pool);
+        free(order);
+        return;
+    }
+
+    for (long long i = 0; i < pop; i++)
+    {
+        tasks[i].vmruntime = xorshift64() % (pop * 4 + 1);
+        tasks[i].pid = i + 1;
+        order[i] = i;
+        if (rq_attach(&pool, &tasks[i]) < 0)
+        {
+            fprintf(stderr, "%s: no room for %lld tasks\n", ops->name, pop);
+            rq_destroy(&rq);
+            rq_pool_destroy(&pool);
+            free(order);
+            return;
+        }
+    }
+    for (long long i = pop - 1; i > 0; i--)
+    {
+        long long j = xorshift64() % (i + 1);
+        long long tmp = order[i];
+        order[i] = order[j];
+        order[j] = tmp;
+    }
+
+    double t0 = now_ns();
+    for (long long i = 0; i < pop; i++) rq_insert(&rq, &tasks[i]);
+    double t1 = now_ns();
+    for (long long i = 0; i < pop; i++) rq_pop_min(&rq);
+    double t2 = now_ns();
+
+    for (long long i = 0; i < pop; i++) rq_insert(&rq, &tasks[i]);
+    double t3 = now_ns();
+    for (long long i = 0; i < pop; i++) rq_remove(&rq, &tasks[order[i]]);
+    double t4 = now_ns();
+
+    for (long long i = 0; i < pop; i++) rq_insert(&rq, &tasks[i]);
+    double t5 = now_ns();
+    for (long long i = 0; i < nr_ops; i++)
+    {
+        struct task *t = rq_pop_min(&rq);
+        t->vmruntime += 4;
+        rq_insert(&rq, t);
+    }
+    double t6 = now_ns();
+
+    printf("%-8s %10lld %10.1f %10.1f %10.1f %10.1f %14llu\n", ops->name, pop,
+        (t1 - t0) / pop, (t2 - t1) / pop, (t4 - t3) / pop, (t6 - t5) / nr_ops,
+        ops->restructures(&rq));
+
+    rq_destroy(&rq);
+    rq_pool_destroy(&pool);
+    free(order);
+}
+
+static void bench_map(enum map_mode mode, struct task *tasks, long long pop)
+{
+    struct hash *map = NULL;
+    volatile long long sink = 0;
+
+    if (map_init_mode(&map, 11, NULL, mode) < 0) return;
+
+    double t0 = now_ns();
+    for (long long i = 0; i < pop; i++) map_insert(&map, tasks[i].pid, &tasks[i]);
+    double t1 = now_ns();
+    for (long long i = 0; i < pop; i++) sink += map_lookup(&map, tasks[xorshift64() % pop].pid) != NULL;
+    double t2 = now_ns();
+    for (long long i = 0; i < pop; i++) map_delete(&map, tasks[i].pid);
+    double t3 = now_ns();
+
+    printf("%-8s %10lld %10.1f %10.1f %10.1f\n", mode == MAP_SWISS ? "swiss" : "linear", pop,
+        (t1 - t0) / pop, (t2 - t1) / pop, (t3 - t2) / pop);
+
+    free_map(map);
+    (void)sink;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s -i TRACE [-rq NAME] [-map linear | swiss] [-cpus N] [-out FORMAT] [-pop N] [-ops N]\n", prog);
+}
+
+int main(int argc, char **argv)
+{
+    struct scheduler scheduler = SCHEDULER_DEFAULTS;
+    const char *input = NULL;
+    long long pop = 0;
+    long long nr_ops = 4 * 1000 * 1000;
+
+    for (int i = 1; i < argc; i++)
+    {
+        int ret = sched_parse_option(&scheduler, argc, argv, &i);
+
+        if (ret > 0) continue;
+        if (ret == 0 && strcmp(argv[i], "-i") == 0 && i + 1 < argc) input = argv[++i];
+        else if (ret == 0 && strcmp(argv[i], "-pop") == 0 && i + 1 < argc) pop = atoll(argv[++i]);
+        else if (ret == 0 && strcmp(argv[i], "-ops") == 0 && i + 1 < argc) nr_ops = atoll(argv[++i]);
+        else
+        {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (!input || nr_ops < 1)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if (bench_sim(&scheduler, input) < 0)
+    {
+        sched_destroy(&scheduler);
+        return 1;
+    }
+    if (pop <= 0) pop = scheduler.max_tasks ? (long long)scheduler.max_tasks : 1;
+    sched_destroy(&scheduler);
+
+    struct task *tasks = calloc(pop, sizeof(struct task));
+    if (!tasks)
+    {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+
+    printf("\n%-8s %10s %10s %10s %10s %10s %14s\n",
+        "rq", "tasks", "insert_ns", "pick_ns", "delete_ns", "churn_ns", "restructures");
+    for (size_t i = 0; i < sizeof(backends) / sizeof(backends[0]); i++)
+    {
+        bench_rq(backends[i], tasks, pop, nr_ops);
+    }
+
+    printf("\n%-8s %10s %10s %10s %10s\n", "map", "tasks", "insert_ns", "lookup_ns", "delete_ns");
+    bench_map(MAP_LINEAR, tasks, pop);
+    bench_map(MAP_SWISS, tasks, pop);
+
+    free(tasks);
+    return 0;
+}
@@ -0,0 +1,196 @@
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include "bucketq.h"
+#include "runqueue.h"
+
+static inline size_t bucket_of(long long vmruntime)
+{
+    return (size_t)((unsigned long long)vmruntime & BUCKETQ_MASK);
+}
+
+int bucketq_init(struct bucketq *q)
+{
+    memset(q->bitmap, 0, sizeof(q->bitmap));
+    q->min = NULL;
+    q->scans = 0;
+
+    q->buckets = calloc(BUCKETQ_SIZE, sizeof(struct bucket));
+    if (!q->buckets)
+    {
+        #ifdef DEBUG
+        fprintf(stderr, "bucketq alloc failed\n");
+        #endif
+        return -1;
+    }
+
+    return 0;
+}
+
+void bucketq_destroy(struct bucketq *q)
+{
+    free(q->buckets);
+    q->buckets = NULL;
+}
+
+// first non-empty bucket at index >= from, or -1
+static long long next_set_bucket(struct bucketq *q, size_t from, size_t to)
+{
+    while (from < to)
+    {
+        size_t word = from / 64;
+        unsigned long long bits = q->bitmap[word] & (~0ULL << (from % 64));
+
+        if (bits)
+        {
+            size_t b = word * 64 + __builtin_ctzll(bits);
+            return b < to ? (long long)b : -1;
+        }
+
+        from = (word + 1) * 64;
+    }
+
+    return -1;
+}
+
+/*
+    Every queued key is >= (v0, pid0), the minimum just removed. Walking the
+    buckets circularly from v0's bucket, the first head that falls inside
+    the window [v0, v0 + BUCKETQ_SIZE) is the new minimum. Only if nothing
+    is inside the window do we compare every head.
+*/
+static struct task *find_min(struct bucketq *q, long long v0)
+{
+    size_t start = bucket_of(v0);
+    long long b;
+
+    for (int lap = 0; lap < 2; lap++)
+    {
+        size_t from = lap ? 0 : start;
+        size_t to   = lap ? start : BUCKETQ_SIZE;
+
+        while ((b = next_set_bucket(q, from, to)) >= 0)
+        {
+            struct task *head = q->buckets[b].head;
+            q->scans++;
+
+            if (head->vmruntime < v0 + BUCKETQ_SIZE) return head;
+            from = b + 1;
+        }
+    }
+
+    struct task *min = NULL;
+    for (b = next_set_bucket(q, 0, BUCKETQ_SIZE); b >= 0; b = next_set_bucket(q, b + 1, BUCKETQ_SIZE))
+    {
+        struct task *head = q->buckets[b].head;
+        if (!min || task_compare(head, min) < 0) min = head;
+    }
+
+    return min;
+}
+
+void bucketq_insert(struct bucketq *q, struct task *node)
+{
+    size_t b = bucket_of(node->vmruntime);
+    struct bucket *bucket = &q->buckets[b];
+
+    // walk back from the tail: equal vruntimes arrive in rising pid order
+    struct task *prev = bucket->tail;
+    while (prev && task_compare(node, prev) < 0) prev = prev->left;
+
+    node->left = prev;
+    node->right = prev ? prev->right : bucket->head;
+    node->parent = NULL;
+
+    if (node->right) node->right->left = node;
+    else bucket->tail = node;
+
+    if (prev) prev->right = node;
+    else bucket->head = node;
+
+    q->bitmap[b / 64] |= 1ULL << (b % 64);
+
+    if (!q->min || task_compare(node, q->min) < 0) q->min = node;
+}
+
+void bucketq_remove(struct bucketq *q, struct task *node)
+{
+    size_t b = bucket_of(node->vmruntime);
+    struct bucket *bucket = &q->buckets[b];
+
+    if (node->left) node->left->right = node->right;
+    else bucket->head = node->right;
+
+    if (node->right) node->right->left = node->left;
+    else bucket->tail = node->left;
+
+    node->left = node->right = NULL;
+
+    if (!bucket->head) q->bitmap[b / 64] &= ~(1ULL << (b % 64));
+
+    if (node == q->min) q->min = find_min(q, node->vmruntime);
+}
+
+static int bucketq_rq_init(struct run_queue *rq)
+{
+    return bucketq_init(&rq->bucketq);
+}
+
+static void bucketq_rq_destroy(struct run_queue *rq)
+{
+    bucketq_destroy(&rq->bucketq);
+}
+
+static void bucketq_rq_insert(struct run_queue *rq, struct task *t)
+{
+    bucketq_insert(&rq->bucketq, t);
+}
+
+static void bucketq_rq_remove(struct run_queue *rq, struct task *t)
+{
+    bucketq_remove(&rq->bucketq, t);
+}
+
+static struct task *bucketq_rq_peek_min(struct run_queue *rq)
+{
+    return bucketq_min(&rq->bucketq);
+}
+
+static struct task *bucketq_rq_pop_min(struct run_queue *rq)
+{
+    struct task *t = bucketq_min(&rq->bucketq);
+    if (t) bucketq_remove(&rq->bucketq, t);
+    return t;
+}
+
+static unsigned long long bucketq_rq_restructures(struct run_queue *rq)
+{
+    return rq->bucketq.scans;
+}
+
+static void bucketq_rq_visit(struct run_queue *rq, struct rq_visitor *v)
+{
+    struct bucketq *q = &rq->bucketq;
+
+    for (size_t i = 0; i < BUCKETQ_SIZE; i++)
+    {
+        v->ptr(v, &q->buckets[i].head);
+        v->ptr(v, &q->buckets[i].tail);
+    }
+    for (size_t i = 0; i < BUCKETQ_WORDS; i++) v->word(v, &q->bitmap[i]);
+    v->ptr(v, &q->min);
+    v->word(v, &q->scans);
+}
+
+const struct rq_ops bucketq_rq_ops = {
+    .name         = "bucket",
+    .init         = bucketq_rq_init,
+    .destroy      = bucketq_rq_destroy,
+    .insert       = bucketq_rq_insert,
+    .remove       = bucketq_rq_remove,
+    .peek_min     = bucketq_rq_peek_min,
+    .pop_min      = bucketq_rq_pop_min,
+    .restructures = bucketq_rq_restructures,
+    .visit        = bucketq_rq_visit,
+};
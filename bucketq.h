@@ -0,0 +1,41 @@
+#ifndef _BUCKETQ_H
+#define _BUCKETQ_H
+#include "task.h"
+
+#define BUCKETQ_BITS        10
+#define BUCKETQ_SIZE        (1 << BUCKETQ_BITS)
+#define BUCKETQ_MASK        (BUCKETQ_SIZE - 1)
+#define BUCKETQ_WORDS       (BUCKETQ_SIZE / 64)
+
+struct bucket
+{
+    struct task *head;
+    struct task *tail;
+};
+
+/*
+    Calendar queue keyed on vruntime: bucket = vruntime & BUCKETQ_MASK, each
+    bucket a list sorted by (vruntime, pid), plus a bitmap of non-empty
+    buckets. CFS keeps runnable vruntimes within a few slices of each
+    other, so the next minimum is normally found by scanning a handful of
+    bitmap words forward from the old one.
+*/
+struct bucketq
+{
+    struct bucket *buckets;
+    unsigned long long bitmap[BUCKETQ_WORDS];
+    struct task *min;
+    unsigned long long scans;   // buckets visited looking for a new minimum
+};
+
+int bucketq_init(struct bucketq *q);
+void bucketq_destroy(struct bucketq *q);
+void bucketq_insert(struct bucketq *q, struct task *node);
+void bucketq_remove(struct bucketq *q, struct task *node);
+
+static inline struct task *bucketq_min(struct bucketq *q)
+{
+    return q->min;
+}
+
+#endif
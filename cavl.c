@@ -0,0 +1,485 @@
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include "cavl.h"
+#include "runqueue.h"
+
+static int grow(struct cavl_pool *p, unsigned int size)
+{
+    struct cavl_node *nodes = realloc(p->nodes, (size_t)size * sizeof(*nodes));
+    if (!nodes) return -1;
+    p->nodes = nodes;
+
+    struct cavl_aux *aux = realloc(p->aux, (size_t)size * sizeof(*aux));
+    if (!aux) return -1;
+    p->aux = aux;
+
+    struct task **tasks = realloc(p->tasks, (size_t)size * sizeof(*tasks));
+    if (!tasks) return -1;
+    p->tasks = tasks;
+
+    p->size = size;
+    return 0;
+}
+
+int cavl_pool_init(struct cavl_pool *p)
+{
+    p->nodes = NULL;
+    p->aux = NULL;
+    p->tasks = NULL;
+    p->free = CAVL_NIL;
+    p->used = 1;
+    p->size = 0;
+
+    if (grow(p, CAVL_INIT_SLOTS) < 0)
+    {
+        #ifdef DEBUG
+        fprintf(stderr, "cavl alloc failed\n");
+        #endif
+        return -1;
+    }
+
+    p->nodes[CAVL_NIL] = (struct cavl_node){ 0, CAVL_NIL, CAVL_NIL };
+    p->aux[CAVL_NIL] = (struct cavl_aux){ CAVL_NIL, 0 };
+    p->tasks[CAVL_NIL] = NULL;
+    return 0;
+}
+
+void cavl_pool_destroy(struct cavl_pool *p)
+{
+    free(p->nodes);
+    free(p->aux);
+    free(p->tasks);
+    p->nodes = NULL;
+    p->aux = NULL;
+    p->tasks = NULL;
+}
+
+// gives t a slot of its own, doubling the pool when it is full; -1 if there is no memory
+int cavl_attach(struct cavl_pool *p, struct task *t)
+{
+    unsigned int n = p->free;
+
+    if (n != CAVL_NIL)
+    {
+        p->free = p->nodes[n].left;
+    }
+    else
+    {
+        if (p->used == p->size && (p->size > 0x7fffffffU || grow(p, p->size * 2) < 0))
+        {
+            #ifdef DEBUG
+            fprintf(stderr, "cavl: out of memory for %u nodes\n", p->size * 2);
+            #endif
+            return -1;
+        }
+        n = p->used++;
+    }
+
+    // childless, the restore in cavl_rq_visit reads the links before it fills them in
+    p->nodes[n].left = p->nodes[n].right = CAVL_NIL;
+    p->tasks[n] = t;
+    t->slot = n;
+    return 0;
+}
+
+void cavl_detach(struct cavl_pool *p, struct task *t)
+{
+    unsigned int n = (unsigned int)t->slot;
+
+    p->tasks[n] = NULL;
+    p->nodes[n].left = p->free;
+    p->free = n;
+}
+
+void cavl_init(struct cavl *q, struct cavl_pool *p)
+{
+    q->pool = p;
+    q->root = q->leftmost = CAVL_NIL;
+    q->rotations = 0;
+}
+
+static inline int height(struct cavl *q, unsigned int n)
+{
+    return q->pool->aux[n].height;
+}
+
+static inline void update_height(struct cavl *q, unsigned int n)
+{
+    struct cavl_pool *p = q->pool;
+    int l = height(q, p->nodes[n].left);
+    int r = height(q, p->nodes[n].right);
+
+    p->aux[n].height = (unsigned short)(1 + (l > r ? l : r));
+}
+
+static inline int balance_factor(struct cavl *q, unsigned int n)
+{
+    struct cavl_node *node = &q->pool->nodes[n];
+    return height(q, node->left) - height(q, node->right);
+}
+
+static inline void change_child(struct cavl *q, unsigned int parent, unsigned int old, unsigned int new)
+{
+    struct cavl_pool *p = q->pool;
+
+    if (parent == CAVL_NIL) q->root = new;
+    else if (p->nodes[parent].left == old) p->nodes[parent].left = new;
+    else p->nodes[parent].right = new;
+}
+
+// the same rotations as avl.c, on slots; writes to the nil slot's parent are harmless
+static unsigned int right_rotate(struct cavl *q, unsigned int n)
+{
+    struct cavl_pool *p = q->pool;
+    unsigned int y  = p->nodes[n].left;
+    unsigned int T2 = p->nodes[y].right;
+    unsigned int parent = p->aux[n].parent;
+
+    p->nodes[n].left = T2;
+    p->aux[T2].parent = n;
+    p->nodes[y].right = n;
+    p->aux[n].parent = y;
+    p->aux[y].parent = parent;
+    change_child(q, parent, n, y);
+
+    update_height(q, n);
+    update_height(q, y);
+
+    q->rotations++;
+    tp_fire(TP_ROTATION, p->tasks[n]->pid, 1, 0);
+    return y;
+}
+
+static unsigned int left_rotate(struct cavl *q, unsigned int n)
+{
+    struct cavl_pool *p = q->pool;
+    unsigned int y  = p->nodes[n].right;
+    unsigned int T2 = p->nodes[y].left;
+    unsigned int parent = p->aux[n].parent;
+
+    p->nodes[n].right = T2;
+    p->aux[T2].parent = n;
+    p->nodes[y].left = n;
+    p->aux[n].parent = y;
+    p->aux[y].parent = parent;
+    change_child(q, parent, n, y);
+
+    update_height(q, n);
+    update_height(q, y);
+
+    q->rotations++;
+    tp_fire(TP_ROTATION, p->tasks[n]->pid, 0, 0);
+    return y;
+}
+
+// as in avl.c: up from n, stopping at the first subtree whose height holds
+static void rebalance_up(struct cavl *q, unsigned int n)
+{
+    struct cavl_pool *p = q->pool;
+
+    while (n != CAVL_NIL)
+    {
+        int old = height(q, n);
+
+        update_height(q, n);
+
+        int bf_cur = balance_factor(q, n);
+        if (bf_cur > 1)
+        {
+            if (balance_factor(q, p->nodes[n].left) < 0) left_rotate(q, p->nodes[n].left);
+            n = right_rotate(q, n);
+        }
+        else if (bf_cur < -1)
+        {
+            if (balance_factor(q, p->nodes[n].right) > 0) right_rotate(q, p->nodes[n].right);
+            n = left_rotate(q, n);
+        }
+
+        if (height(q, n) == old) return;
+        n = p->aux[n].parent;
+    }
+}
+
+static unsigned int first(struct cavl *q, unsigned int n)
+{
+    struct cavl_pool *p = q->pool;
+
+    while (p->nodes[n].left != CAVL_NIL) n = p->nodes[n].left;
+    return n;
+}
+
+static unsigned int next_slot(struct cavl *q, unsigned int n)
+{
+    struct cavl_pool *p = q->pool;
+
+    if (p->nodes[n].right != CAVL_NIL) return first(q, p->nodes[n].right);
+
+    unsigned int parent = p->aux[n].parent;
+    while (parent != CAVL_NIL && n == p->nodes[parent].right)
+    {
+        n = parent;
+        parent = p->aux[n].parent;
+    }
+    return parent;
+}
+
+// hangs the unlinked slot n under its place in (vruntime, pid) order,
+// the pids are only read when the hot keys tie
+static void link_slot(struct cavl *q, unsigned int n)
+{
+    struct cavl_pool *p = q->pool;
+    struct cavl_node *nodes = p->nodes;
+    long long vruntime = nodes[n].vruntime;
+    unsigned int parent = CAVL_NIL;
+    unsigned int *link = &q->root;
+    char is_leftmost = 1;
+
+    nodes[n].left = nodes[n].right = CAVL_NIL;
+    p->aux[n].height = 1;
+
+    while (*link != CAVL_NIL)
+    {
+        parent = *link;
+        if (vruntime < nodes[parent].vruntime ||
+            (vruntime == nodes[parent].vruntime && p->tasks[n]->pid < p->tasks[parent]->pid))
+        {
+            link = &nodes[parent].left;
+        }
+        else
+        {
+            link = &nodes[parent].right;
+            is_leftmost = 0;
+        }
+    }
+
+    *link = n;
+    p->aux[n].parent = parent;
+    if (is_leftmost) q->leftmost = n;
+    rebalance_up(q, parent);
+}
+
+// takes slot n out of the tree, a node with two children gives way to its successor
+static void unlink_slot(struct cavl *q, unsigned int n)
+{
+    struct cavl_pool *p = q->pool;
+    unsigned int parent = p->aux[n].parent;
+    unsigned int left = p->nodes[n].left;
+    unsigned int right = p->nodes[n].right;
+    unsigned int fix;
+
+    if (n == q->leftmost) q->leftmost = next_slot(q, n);
+
+    if (left == CAVL_NIL || right == CAVL_NIL)
+    {
+        unsigned int child = left != CAVL_NIL ? left : right;
+
+        p->aux[child].parent = parent;
+        change_child(q, parent, n, child);
+        fix = parent;
+    }
+    else
+    {
+        unsigned int successor = first(q, right);
+
+        fix = successor;
+        if (successor != right)
+        {
+            fix = p->aux[successor].parent;
+            p->nodes[fix].left = p->nodes[successor].right;
+            p->aux[p->nodes[successor].right].parent = fix;
+            p->nodes[successor].right = right;
+            p->aux[right].parent = successor;
+        }
+
+        p->nodes[successor].left = left;
+        p->aux[left].parent = successor;
+        p->aux[successor].parent = parent;
+        p->aux[successor].height = p->aux[n].height;
+        change_child(q, parent, n, successor);
+    }
+
+    rebalance_up(q, fix);
+}
+
+// t brings its own slot, see cavl_attach
+void cavl_insert(struct cavl *q, struct task *t)
+{
+    unsigned int n = (unsigned int)t->slot;
+
+    q->pool->nodes[n].vruntime = t->vmruntime;
+    link_slot(q, n);
+}
+
+void cavl_remove(struct cavl *q, struct task *t)
+{
+    unlink_slot(q, (unsigned int)t->slot);
+}
+
+struct task *cavl_next(struct cavl *q, struct task *t)
+{
+    return q->pool->tasks[next_slot(q, (unsigned int)t->slot)];
+}
+
+// in place while the key grows and stays before the successor, like
+// avl_update_key_cached, else moved in its own slot
+void cavl_update(struct cavl *q, struct task *t, long long vruntime)
+{
+    struct cavl_pool *p = q->pool;
+    unsigned int n = (unsigned int)t->slot;
+    unsigned int next = next_slot(q, n);
+
+    t->vmruntime = vruntime;
+    if (vruntime >= p->nodes[n].vruntime && (next == CAVL_NIL || vruntime < p->nodes[next].vruntime ||
+        (vruntime == p->nodes[next].vruntime && t->pid < p->tasks[next]->pid)))
+    {
+        p->nodes[n].vruntime = vruntime;
+        return;
+    }
+
+    unlink_slot(q, n);
+    p->nodes[n].vruntime = vruntime;
+    link_slot(q, n);
+}
+
+static int cavl_rq_init(struct run_queue *rq)
+{
+    cavl_init(&rq->cavl, &rq->pool->cavl);
+    return 0;
+}
+
+static int cavl_rq_pool_init(struct rq_pool *pool)
+{
+    return cavl_pool_init(&pool->cavl);
+}
+
+static void cavl_rq_pool_destroy(struct rq_pool *pool)
+{
+    cavl_pool_destroy(&pool->cavl);
+}
+
+static int cavl_rq_attach(struct rq_pool *pool, struct task *t)
+{
+    return cavl_attach(&pool->cavl, t);
+}
+
+static void cavl_rq_detach(struct rq_pool *pool, struct task *t)
+{
+    cavl_detach(&pool->cavl, t);
+}
+
+static void cavl_rq_insert(struct run_queue *rq, struct task *t)
+{
+    cavl_insert(&rq->cavl, t);
+}
+
+static void cavl_rq_remove(struct run_queue *rq, struct task *t)
+{
+    cavl_remove(&rq->cavl, t);
+}
+
+static struct task *cavl_rq_peek_min(struct run_queue *rq)
+{
+    return cavl_min(&rq->cavl);
+}
+
+// straight from the leftmost slot, without waiting on the task for its slot
+static struct task *cavl_rq_pop_min(struct run_queue *rq)
+{
+    struct cavl *q = &rq->cavl;
+    unsigned int n = q->leftmost;
+    struct task *t = q->pool->tasks[n];
+
+    if (n == CAVL_NIL) return NULL;
+    unlink_slot(q, n);
+    return t;
+}
+
+static void cavl_rq_update(struct run_queue *rq, struct task *t, long long vruntime)
+{
+    cavl_update(&rq->cavl, t, vruntime);
+}
+
+static struct task *cavl_rq_next(struct run_queue *rq, struct task *t)
+{
+    return cavl_next(&rq->cavl, t);
+}
+
+static unsigned long long cavl_rq_restructures(struct run_queue *rq)
+{
+    return rq->cavl.rotations;
+}
+
+/*
+    Pre-order from n, each node as the tasks of its children and its
+    height, so a restore has filled in a node's children before it goes
+    down to them. The tasks bring their own slots (a restore attaches
+    them afresh), only the shape of the tree is saved. nr caps the nodes a
+    damaged checkpoint could make it walk.
+*/
+static void visit_slot(struct cavl *q, unsigned int n, int depth, long long *nr, struct rq_visitor *v)
+{
+    struct cavl_pool *p = q->pool;
+    struct task *left = p->tasks[p->nodes[n].left];
+    struct task *right = p->tasks[p->nodes[n].right];
+    unsigned long long height = p->aux[n].height;
+
+    if (v->err || depth >= CAVL_MAX_HEIGHT || --*nr < 0)
+    {
+        v->err = 1;
+        return;
+    }
+
+    v->ptr(v, &left);
+    v->ptr(v, &right);
+    v->word(v, &height);
+    p->nodes[n].vruntime = p->tasks[n]->vmruntime;
+    p->nodes[n].left = left ? (unsigned int)left->slot : CAVL_NIL;
+    p->nodes[n].right = right ? (unsigned int)right->slot : CAVL_NIL;
+    p->aux[n].height = (unsigned short)height;
+
+    if (left)
+    {
+        p->aux[left->slot].parent = n;
+        visit_slot(q, (unsigned int)left->slot, depth + 1, nr, v);
+    }
+    if (right)
+    {
+        p->aux[right->slot].parent = n;
+        visit_slot(q, (unsigned int)right->slot, depth + 1, nr, v);
+    }
+}
+
+static void cavl_rq_visit(struct run_queue *rq, struct rq_visitor *v)
+{
+    struct cavl *q = &rq->cavl;
+    struct task *root = q->pool->tasks[q->root];
+    long long nr = rq->nr_running;
+
+    v->ptr(v, &root);
+    v->word(v, &q->rotations);
+    q->root = root ? (unsigned int)root->slot : CAVL_NIL;
+    q->pool->aux[q->root].parent = CAVL_NIL;
+    if (root) visit_slot(q, q->root, 0, &nr, v);
+
+    if (nr) v->err = 1;
+    if (v->err) q->root = CAVL_NIL;
+    q->leftmost = first(q, q->root);
+}
+
+const struct rq_ops cavl_rq_ops = {
+    .name         = "cavl",
+    .init         = cavl_rq_init,
+    .insert       = cavl_rq_insert,
+    .remove       = cavl_rq_remove,
+    .pool_init    = cavl_rq_pool_init,
+    .pool_destroy = cavl_rq_pool_destroy,
+    .attach       = cavl_rq_attach,
+    .detach       = cavl_rq_detach,
+    .peek_min     = cavl_rq_peek_min,
+    .pop_min      = cavl_rq_pop_min,
+    .update       = cavl_rq_update,
+    .next         = cavl_rq_next,
+    .restructures = cavl_rq_restructures,
+    .visit        = cavl_rq_visit,
+};
@@ -0,0 +1,70 @@
+#ifndef _CAVL_H
+#define _CAVL_H
+#include "task.h"
+
+#define CAVL_NIL            0       // slot 0: the empty subtree, height 0
+#define CAVL_INIT_SLOTS     64
+#define CAVL_MAX_HEIGHT     48      // more than 2^32 slots would take
+
+/*
+    Compact AVL tree (-rq cavl): the same tree as avl.c, but its nodes live
+    in arrays and link to each other by 32-bit slot index instead of
+    through the tasks' own pointers. A descent only reads the 16-byte hot
+    nodes (key and children, four to a cache line, all in one block) and
+    never touches a 128-byte struct task; the parent link and height sit
+    in a second array, the task pointer in a third, and the pid there is
+    only read to break a tie on vruntime.
+
+    The arrays are a pool shared by every queue of a simulation. Each
+    entity takes its slot when it is created (cavl_attach) and keeps it,
+    in t->slot, until it is freed, so the pool holds one node per live
+    entity however many CPUs and groups there are, and no insert has to
+    allocate. Freed slots are reused first.
+*/
+struct cavl_node
+{
+    long long vruntime;
+    unsigned int left;
+    unsigned int right;
+};
+
+struct cavl_aux
+{
+    unsigned int parent;
+    unsigned short height;      // not a char, whose stores may alias the nodes and force reloads
+};
+
+struct cavl_pool
+{
+    struct cavl_node *nodes;
+    struct cavl_aux *aux;
+    struct task **tasks;
+    unsigned int free;          // freed slots, chained through left
+    unsigned int used;          // slots handed out so far, CAVL_NIL included
+    unsigned int size;          // slots allocated
+};
+
+struct cavl
+{
+    struct cavl_pool *pool;
+    unsigned int root;
+    unsigned int leftmost;
+    unsigned long long rotations;
+};
+
+int cavl_pool_init(struct cavl_pool *p);
+void cavl_pool_destroy(struct cavl_pool *p);
+int cavl_attach(struct cavl_pool *p, struct task *t);
+void cavl_detach(struct cavl_pool *p, struct task *t);
+void cavl_init(struct cavl *q, struct cavl_pool *p);
+void cavl_insert(struct cavl *q, struct task *t);
+void cavl_remove(struct cavl *q, struct task *t);
+struct task *cavl_next(struct cavl *q, struct task *t);
+void cavl_update(struct cavl *q, struct task *t, long long vruntime);
+
+static inline struct task *cavl_min(struct cavl *q)
+{
+    return q->pool->tasks[q->leftmost];
+}
+
+#endif
@@ -0,0 +1,550 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "checkpoint.h"
+
+static inline size_t task_hist_bytes(void)
+{
+    return HIST_NR_METRICS * hist_size(HIST_TASK_BITS);
+}
+
+struct ckpt_writer
+{
+    struct rq_visitor v;        // first: the callbacks cast back to the writer
+    FILE *out;
+    struct task **ents;         // every entity, by address
+    long long nr_ents;
+    long long nr_words;
+    int err;
+};
+
+static int ptr_compare(const void *a, const void *b)
+{
+    uintptr_t x = (uintptr_t)*(struct task *const *)a;
+    uintptr_t y = (uintptr_t)*(struct task *const *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+// entity index + 1 of t, 0 for NULL
+static long long ent_ref(struct ckpt_writer *w, const struct task *t)
+{
+    long long lo = 0, hi = w->nr_ents - 1;
+
+    if (!t) return 0;
+    while (lo <= hi)
+    {
+        long long mid = lo + (hi - lo) / 2;
+
+        if (w->ents[mid] == t) return mid + 1;
+        if ((uintptr_t)w->ents[mid] < (uintptr_t)t) lo = mid + 1;
+        else hi = mid - 1;
+    }
+
+    #ifdef DEBUG
+    fprintf(stderr, "checkpoint: link to pid=%lld outside the live tasks\n", t->pid);
+    #endif
+    w->err = 1;
+    return 0;
+}
+
+static void put(struct ckpt_writer *w, const void *p, size_t n)
+{
+    if (!w->err && fwrite(p, 1, n, w->out) != n) w->err = 1;
+}
+
+static void save_ptr(struct rq_visitor *v, struct task **slot)
+{
+    struct ckpt_writer *w = (struct ckpt_writer *)v;
+    unsigned long long ref = ent_ref(w, *slot);
+
+    put(w, &ref, sizeof(ref));
+    w->nr_words++;
+}
+
+static void save_word(struct rq_visitor *v, unsigned long long *slot)
+{
+    struct ckpt_writer *w = (struct ckpt_writer *)v;
+
+    put(w, slot, sizeof(*slot));
+    w->nr_words++;
+}
+
+static void save_queue(struct ckpt_writer *w, struct run_queue *rq)
+{
+    unsigned long long nr_running = rq->nr_running;
+    unsigned long long min_vruntime = rq->min_vruntime;
+    unsigned long long load = rq->load;
+    unsigned long long avg_vruntime = rq->avg_vruntime;
+    unsigned long long avg_load = rq->avg_load;
+
+    save_word(&w->v, &nr_running);
+    save_word(&w->v, &min_vruntime);
+    save_word(&w->v, &load);
+    save_word(&w->v, &avg_vruntime);
+    save_word(&w->v, &avg_load);
+    rq->ops->visit(rq, &w->v);
+}
+
+static void save_entity(struct scheduler *s, struct ckpt_writer *w, struct task *t)
+{
+    struct ckpt_entity e = {
+        .vmruntime = t->vmruntime,
+        .remaining_time = t->remaining_time,
+        .pid = t->pid,
+        .height = t->height,
+        .runnable_since = t->runnable_since,
+        .deadline = t->deadline,
+        .min_deadline = t->min_deadline,
+        .vlag = t->vlag,
+        .group = t->group ? t->group->id : 0,
+        .cpu = t->cpu,
+        .on_rq = t->on_rq,
+        .weight = t->weight,
+        .inv_weight = t->inv_weight,
+        .vruntime_frac = t->vruntime_frac,
+        .wake_pending = t->wake_pending,
+        .is_group = t->is_group,
+        .timer_slot = t->timer_slot,
+    };
+
+    // the links of a task off its queue are stale, they may point at freed
+    // tasks, unless a timer wheel slot holds it (left / right only); a
+    // backend with a node pool keeps a queued task's links in its own nodes
+    int linked = t->on_rq && !s->rq_ops->attach;
+
+    if (linked || t->timer_slot)
+    {
+        e.left = ent_ref(w, t->left);
+        e.right = ent_ref(w, t->right);
+    }
+    if (linked) e.parent = ent_ref(w, t->parent);
+
+    if (t->is_group)
+    {
+        struct group_cpu *gc = (struct group_cpu *)((char *)t - offsetof(struct group_cpu, se));
+        e.nr_busy = gc->nr_busy;
+    }
+    else
+    {
+        e.asleep = map_lookup(&s->wake_queue_task_map, t->pid) == t;
+        e.has_hist = t->hist != NULL;
+    }
+
+    put(w, &e, sizeof(e));
+}
+
+// groups oldest first, so a parent always comes before its children
+static struct task_group **groups_by_age(struct scheduler *s, long long *nr)
+{
+    long long n = 0;
+    for (struct task_group *g = s->groups; g; g = g->next) n++;
+
+    struct task_group **groups = malloc((n ? n : 1) * sizeof(*groups));
+    if (!groups) return NULL;
+
+    long long i = n;
+    for (struct task_group *g = s->groups; g; g = g->next) groups[--i] = g;
+
+    *nr = n;
+    return groups;
+}
+
+static int write_checkpoint(struct scheduler *s, struct ckpt_writer *w, struct task_group **groups, long long nr_groups)
+{
+    struct ckpt_header h = {
+        .version = CKPT_VERSION,
+        .entity_size = sizeof(struct ckpt_entity),
+        .nr_cpus = s->nr_cpus,
+        .trace_format = s->trace->format,
+        .hist_format = s->hist_format,
+        .nr_groups = nr_groups,
+        .nr_entities = w->nr_ents,
+        .last_command = s->last_command,
+        .event_complete = s->event_complete,
+        .nr_events = s->nr_events,
+        .nr_slices = s->nr_slices,
+        .nr_coalesced = s->nr_coalesced,
+        .nr_migrations = s->nr_migrations,
+        .number_of_tasks = s->number_of_tasks,
+        .sim_time = s->sim_time,
+        .next_balance = s->next_balance,
+        .max_tasks = s->max_tasks,
+        .queue_seq = s->queue_seq,
+    };
+
+    memcpy(h.magic, CKPT_MAGIC, sizeof(CKPT_MAGIC));
+    snprintf(h.rq_name, sizeof(h.rq_name), "%s", s->rq_ops->name);
+    snprintf(h.policy_name, sizeof(h.policy_name), "%s", s->policy->name);
+    memcpy(h.records, s->output.records, sizeof(h.records));
+    if (trace_tell(s->trace, &h.trace_pos) < 0) return -1;
+
+    // written again at the end, once the queue word count is known
+    put(w, &h, sizeof(h));
+
+    for (int i = 0; i < s->nr_cpus; i++)
+    {
+        struct cpu *cpu = &s->cpus[i];
+        struct ckpt_cpu c = {
+            .curr = ent_ref(w, cpu->curr),
+            .h_nr_running = cpu->h_nr_running,
+            .slice = cpu->slice,
+            .clock = cpu->clock,
+            .busy_time = cpu->busy_time,
+            .migrations_in = cpu->migrations_in,
+            .migrations_out = cpu->migrations_out,
+        };
+        put(w, &c, sizeof(c));
+    }
+
+    for (long long i = 0; i < nr_groups; i++)
+    {
+        struct task_group *g = groups[i];
+        struct ckpt_group c = {
+            .id = g->id,
+            .parent = g->parent ? g->parent->id : 0,
+            .shares = g->shares,
+        };
+        put(w, &c, sizeof(c));
+    }
+
+    for (long long i = 0; i < w->nr_ents; i++) save_entity(s, w, w->ents[i]);
+
+    for (int i = 0; i < s->nr_cpus; i++) save_queue(w, &s->cpus[i].run_queue);
+    for (long long i = 0; i < nr_groups; i++)
+    {
+        for (int c = 0; c < s->nr_cpus; c++) save_queue(w, &groups[i]->cpus[c].rq);
+    }
+    tw_visit(&s->timers, &w->v);
+    h.nr_queue_words = w->nr_words;
+
+    if (h.hist_format)
+    {
+        for (int m = 0; m < HIST_NR_METRICS; m++) put(w, s->hist[m], hist_size(HIST_GLOBAL_BITS));
+    }
+    for (long long i = 0; i < w->nr_ents; i++)
+    {
+        struct task *t = w->ents[i];
+        if (t->is_group || !t->hist) continue;
+
+        put(w, t->hist, task_hist_bytes());
+    }
+
+    if (w->err || fseek(w->out, 0, SEEK_SET) != 0) return -1;
+    put(w, &h, sizeof(h));
+    return w->err ? -1 : 0;
+}
+
+/*
+    Writes the state at the top of the current sched_run step to path.
+    The event log is flushed first, so it ends exactly where a run
+    restored from this file starts.
+*/
+int sched_checkpoint(struct scheduler *s, const char *path)
+{
+    struct ckpt_writer w = { .v = { save_ptr, save_word } };
+    struct hash *pids = s->pid_map;
+    long long nr_groups = 0;
+    struct task_group **groups = groups_by_age(s, &nr_groups);
+
+    out_flush(&s->output);
+    fflush(s->out);
+
+    w.ents = malloc((pids->num_of_elements + nr_groups * s->nr_cpus + 1) * sizeof(struct task *));
+    if (!groups || !w.ents)
+    {
+        free(groups);
+        free(w.ents);
+        return -1;
+    }
+
+    for (long long i = 0; i < pids->table_size; i++)
+    {
+        if (pids->hashmap[i].val) w.ents[w.nr_ents++] = pids->hashmap[i].val;
+    }
+    for (long long i = 0; i < nr_groups; i++)
+    {
+        for (int c = 0; c < s->nr_cpus; c++) w.ents[w.nr_ents++] = &groups[i]->cpus[c].se;
+    }
+    qsort(w.ents, w.nr_ents, sizeof(struct task *), ptr_compare);
+
+    int ret = -1;
+    w.out = fopen(path, "wb");
+    if (w.out)
+    {
+        ret = write_checkpoint(s, &w, groups, nr_groups);
+        if (fclose(w.out) != 0) ret = -1;
+    }
+
+    free(groups);
+    free(w.ents);
+    return ret;
+}
+
+struct ckpt_reader
+{
+    struct rq_visitor v;        // first: the callbacks cast back to the reader
+    const unsigned char *pos;
+    const unsigned char *end;
+    struct task **ents;         // by entity index
+    long long nr_ents;
+    int err;
+};
+
+// the next nr records of size bytes out of the mapping
+static const void *take(struct ckpt_reader *r, long long nr, size_t size)
+{
+    const void *p = r->pos;
+
+    if (r->err || nr < 0 || (size_t)nr > (size_t)(r->end - r->pos) / size)
+    {
+        r->err = 1;
+        return NULL;
+    }
+
+    r->pos += nr * size;
+    return p;
+}
+
+static struct task *ent_at(struct ckpt_reader *r, long long ref)
+{
+    if (ref == 0) return NULL;
+    if (ref < 0 || ref > r->nr_ents)
+    {
+        r->err = 1;
+        return NULL;
+    }
+
+    return r->ents[ref - 1];
+}
+
+static void load_word(struct rq_visitor *v, unsigned long long *slot)
+{
+    struct ckpt_reader *r = (struct ckpt_reader *)v;
+    const unsigned long long *word = take(r, 1, sizeof(*word));
+
+    *slot = word ? *word : 0;
+}
+
+static void load_ptr(struct rq_visitor *v, struct task **slot)
+{
+    struct ckpt_reader *r = (struct ckpt_reader *)v;
+    unsigned long long ref;
+
+    load_word(v, &ref);
+    *slot = ent_at(r, (long long)ref);
+}
+
+static void load_queue(struct ckpt_reader *r, struct run_queue *rq)
+{
+    unsigned long long nr_running, min_vruntime, load, avg_vruntime, avg_load;
+
+    load_word(&r->v, &nr_running);
+    load_word(&r->v, &min_vruntime);
+    load_word(&r->v, &load);
+    load_word(&r->v, &avg_vruntime);
+    load_word(&r->v, &avg_load);
+    rq->nr_running = (long long)nr_running;
+    rq->min_vruntime = (long long)min_vruntime;
+    rq->load = load;
+    rq->avg_vruntime = (long long)avg_vruntime;
+    rq->avg_load = (long long)avg_load;
+    rq->ops->visit(rq, &r->v);
+    if (r->v.err) r->err = 1;
+}
+
+// one pass to give every entity its address, the next to fill in the links
+static int load_entities(struct scheduler *s, struct ckpt_reader *r, const struct ckpt_entity *recs)
+{
+    for (long long i = 0; i < r->nr_ents; i++)
+    {
+        const struct ckpt_entity *e = &recs[i];
+
+        if (e->cpu < 0 || e->cpu >= s->nr_cpus) return -1;
+        if (e->is_group)
+        {
+            struct task_group *tg = sched_find_group(s, -e->pid);
+            if (!tg) return -1;
+            r->ents[i] = &tg->cpus[e->cpu].se;
+            tg->cpus[e->cpu].nr_busy = e->nr_busy;
+        }
+        else if (!(r->ents[i] = slab_alloc(&s->task_slab)) || rq_attach(&s->rq_pool, r->ents[i]) < 0)
+        {
+            return -1;
+        }
+    }
+
+    for (long long i = 0; i < r->nr_ents; i++)
+    {
+        const struct ckpt_entity *e = &recs[i];
+        struct task *t = r->ents[i];
+
+        t->vmruntime = e->vmruntime;
+        t->remaining_time = e->remaining_time;
+        t->pid = e->pid;
+        if (!s->rq_ops->attach) t->height = e->height;     // else the slot rq_attach gave it
+        t->runnable_since = e->runnable_since;
+        t->deadline = e->deadline;
+        t->min_deadline = e->min_deadline;
+        t->vlag = e->vlag;
+        t->left = ent_at(r, e->left);
+        t->right = ent_at(r, e->right);
+        t->parent = ent_at(r, e->parent);
+        t->group = e->group ? sched_find_group(s, e->group) : NULL;
+        t->cpu = e->cpu;
+        t->on_rq = e->on_rq;
+        t->weight = e->weight;
+        t->inv_weight = e->inv_weight;
+        t->vruntime_frac = e->vruntime_frac;
+        t->wake_pending = e->wake_pending;
+        t->is_group = e->is_group;
+        t->timer_slot = e->timer_slot;
+        if (t->is_group) continue;
+
+        t->hist = NULL;
+        map_insert(&s->pid_map, t->pid, t);
+        if (e->asleep) map_insert(&s->wake_queue_task_map, t->pid, t);
+    }
+
+    return r->err ? -1 : 0;
+}
+
+static int load_hists(struct scheduler *s, struct ckpt_reader *r, const struct ckpt_header *h,
+    const struct ckpt_entity *recs)
+{
+    int keep_tasks = s->hist_format && s->hist_tasks;
+
+    if (h->hist_format)
+    {
+        for (int m = 0; m < HIST_NR_METRICS; m++)
+        {
+            const void *saved = take(r, 1, hist_size(HIST_GLOBAL_BITS));
+            if (saved && s->hist_format) memcpy(s->hist[m], saved, hist_size(HIST_GLOBAL_BITS));
+        }
+    }
+
+    for (long long i = 0; i < r->nr_ents; i++)
+    {
+        struct task *t = r->ents[i];
+        const void *saved = recs[i].has_hist ? take(r, 1, task_hist_bytes()) : NULL;
+
+        if (t->is_group || !keep_tasks) continue;
+        if (!(t->hist = slab_alloc(&s->hist_slab))) return -1;
+
+        if (saved)
+        {
+            memcpy(t->hist, saved, task_hist_bytes());
+            continue;
+        }
+        for (int m = 0; m < HIST_NR_METRICS; m++)
+        {
+            hist_init((struct hist *)((char *)t->hist + m * hist_size(HIST_TASK_BITS)), HIST_TASK_BITS);
+        }
+    }
+
+    return r->err ? -1 : 0;
+}
+
+static int restore(struct scheduler *s, struct ckpt_reader *r)
+{
+    const struct ckpt_header *h = take(r, 1, sizeof(*h));
+
+    if (!h || memcmp(h->magic, CKPT_MAGIC, sizeof(CKPT_MAGIC)) != 0 || h->version != CKPT_VERSION ||
+        h->entity_size != sizeof(struct ckpt_entity) || strncmp(h->rq_name, s->rq_ops->name, sizeof(h->rq_name)) != 0 ||
+        strncmp(h->policy_name, s->policy->name, sizeof(h->policy_name)) != 0 ||
+        h->nr_cpus != s->nr_cpus || h->trace_format != (int)s->trace->format)
+    {
+        #ifdef DEBUG
+        fprintf(stderr, "checkpoint does not match this run (backend, policy, cpus or trace format)\n");
+        #endif
+        return -1;
+    }
+
+    const struct ckpt_cpu *cpus = take(r, h->nr_cpus, sizeof(*cpus));
+    const struct ckpt_group *groups = take(r, h->nr_groups, sizeof(*groups));
+    const struct ckpt_entity *recs = take(r, h->nr_entities, sizeof(*recs));
+    if (r->err) return -1;
+
+    for (long long i = 0; i < h->nr_groups; i++)
+    {
+        struct task_group *tg = sched_new_group(s, groups[i].id, groups[i].shares, groups[i].parent);
+        if (!tg) return -1;
+    }
+
+    r->nr_ents = h->nr_entities;
+    r->ents = malloc((r->nr_ents + 1) * sizeof(struct task *));
+    if (!r->ents || load_entities(s, r, recs) < 0) return -1;
+
+    const unsigned char *queues = r->pos;
+    for (int i = 0; i < s->nr_cpus; i++) load_queue(r, &s->cpus[i].run_queue);
+    for (long long i = 0; i < h->nr_groups; i++)
+    {
+        struct task_group *tg = sched_find_group(s, groups[i].id);
+        for (int c = 0; c < s->nr_cpus; c++) load_queue(r, &tg->cpus[c].rq);
+    }
+    tw_visit(&s->timers, &r->v);
+    if (r->err || r->pos - queues != h->nr_queue_words * (long long)sizeof(unsigned long long)) return -1;
+
+    for (int i = 0; i < s->nr_cpus; i++)
+    {
+        struct cpu *cpu = &s->cpus[i];
+
+        cpu->curr = ent_at(r, cpus[i].curr);
+        cpu->h_nr_running = cpus[i].h_nr_running;
+        cpu->slice = cpus[i].slice;
+        cpu->clock = cpus[i].clock;
+        cpu->busy_time = cpus[i].busy_time;
+        cpu->migrations_in = cpus[i].migrations_in;
+        cpu->migrations_out = cpus[i].migrations_out;
+    }
+
+    if (load_hists(s, r, h, recs) < 0 || trace_seek(s->trace, &h->trace_pos) < 0) return -1;
+
+    s->last_command = h->last_command;
+    s->event_complete = h->event_complete;
+    s->nr_events = h->nr_events;
+    s->nr_slices = h->nr_slices;
+    s->nr_coalesced = h->nr_coalesced;
+    s->nr_migrations = h->nr_migrations;
+    s->number_of_tasks = h->number_of_tasks;
+    s->sim_time = h->sim_time;
+    s->next_balance = h->next_balance;
+    s->max_tasks = h->max_tasks;
+    s->queue_seq = h->queue_seq;
+    memcpy(s->output.records, h->records, sizeof(h->records));
+    return 0;
+}
+
+int sched_restore(struct scheduler *s, const char *path)
+{
+    struct stat st;
+    int fd = open(path, O_RDONLY);
+
+    if (fd < 0) return -1;
+    if (fstat(fd, &st) < 0 || st.st_size < (off_t)sizeof(struct ckpt_header))
+    {
+        close(fd);
+        return -1;
+    }
+
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);  // the mapping outlives the descriptor
+    if (map == MAP_FAILED) return -1;
+
+    struct ckpt_reader r = {
+        .v = { load_ptr, load_word },
+        .pos = map,
+        .end = (const unsigned char *)map + st.st_size,
+    };
+    int ret = restore(s, &r);
+
+    free(r.ents);
+    munmap(map, st.st_size);
+    return ret;
+}
@@ -0,0 +1,115 @@
+#ifndef _CHECKPOINT_H
+#define _CHECKPOINT_H
+#include "scheduler.h"
+
+/*
+    Snapshot of a running simulation, taken at the top of a sched_run step
+    (-checkpoint FILE -checkpoint-at MS) and loaded by sched_init in place
+    of the trace's first event (-restore FILE). Every file section is a
+    fixed-size record array, so restore maps the file and reads it
+    straight through:
+
+        header      ckpt_header: layout checks, counts, scalar state
+        cpus        ckpt_cpu[nr_cpus]
+        groups      ckpt_group[nr_groups], parents before children
+        entities    ckpt_entity[nr_entities]: tasks and group entities
+        queues      u64 words: per CPU queue, then per group and CPU,
+                    nr_running, min_vruntime, avg_vruntime, avg_load and
+                    the backend's visit(), then the timer wheel's
+                    tw_visit()
+        hists       whole-run histograms, then one block per task that
+                    has its own (has_hist), in entity order
+
+    Pointers are stored as entity indices + 1 (0 = NULL). Restore
+    allocates each entity once and rebuilds every queue and timer wheel
+    slot by patching these links back in, so the trees come back exactly
+    as they were, with no inserts or rebalancing. The backend, policy
+    and CPU count must match. Timing knobs such as -balance-interval and -coalesce may differ, so
+    one checkpoint can branch into several what-if runs. The file is
+    native-endian and meant for the machine that wrote it. Tracepoint
+    rings start empty after a restore. Histograms carry over when both
+    runs keep them.
+*/
+#define CKPT_MAGIC          "CFSCKPT"
+#define CKPT_VERSION        6
+
+struct ckpt_header
+{
+    char magic[8];
+    unsigned int version;
+    unsigned int entity_size;       // sizeof(struct ckpt_entity)
+    char rq_name[16];
+    char policy_name[16];
+    int nr_cpus;
+    int trace_format;
+    int hist_format;
+    int pad0;
+    long long nr_groups;
+    long long nr_entities;
+    long long nr_queue_words;
+    struct trace_pos trace_pos;
+    struct input last_command;
+    int event_complete;
+    int pad1;
+    unsigned long long nr_events;
+    unsigned long long nr_slices;
+    unsigned long long nr_coalesced;
+    unsigned long long nr_migrations;
+    unsigned long long records[OUT_NR_KINDS];
+    long long number_of_tasks;
+    long long sim_time;
+    long long next_balance;
+    long long max_tasks;
+    long long queue_seq;
+};
+
+struct ckpt_cpu
+{
+    long long curr;                 // entity index + 1
+    long long h_nr_running;
+    long long slice;
+    long long clock;
+    long long busy_time;
+    unsigned long long migrations_in;
+    unsigned long long migrations_out;
+};
+
+struct ckpt_group
+{
+    long long id;
+    long long parent;               // id, 0 = root
+    long long shares;
+};
+
+struct ckpt_entity
+{
+    long long vmruntime;
+    long long remaining_time;
+    long long pid;
+    long long height;               // avl height / rbtree color / cavl slot
+    long long runnable_since;
+    long long left;                 // entity index + 1
+    long long right;
+    long long parent;
+    long long group;                // id of its group, 0 = root
+    long long nr_busy;              // group entities: group_cpu.nr_busy
+    long long deadline;             // eevdf deadline / rr time_slice
+    long long min_deadline;         // or timer expiry
+    long long vlag;
+    int cpu;
+    int on_rq;
+    unsigned int weight;
+    unsigned int inv_weight;
+    unsigned int vruntime_frac;
+    unsigned char wake_pending;
+    unsigned char is_group;
+    unsigned char asleep;           // parked in the wake map
+    unsigned char has_hist;
+    unsigned short timer_slot;
+};
+
+int sched_checkpoint(struct scheduler *s, const char *path);
+// fills a scheduler sched_init has set up up to its first trace_next
+int sched_restore(struct scheduler *s, const char *path);
+
+#endif
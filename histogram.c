@@ -0,0 +1,44 @@
+#include <string.h>
+#include "histogram.h"
+
+void hist_init(struct hist *h, unsigned int sub_bits)
+{
+    memset(h, 0, hist_size(sub_bits));
+    h->sub_bits = sub_bits;
+    h->nr_buckets = hist_nr_buckets(sub_bits);
+}
+
+// largest value that lands in bucket i
+static unsigned long long bucket_top(unsigned int sub_bits, unsigned int i)
+{
+    if (i < (1u << sub_bits)) return i;
+
+    int shift = (int)(i >> sub_bits) - 1;
+    unsigned long long low = (unsigned long long)((i & ((1u << sub_bits) - 1)) | (1u << sub_bits)) << shift;
+    return low + (1ULL << shift) - 1;
+}
+
+unsigned long long hist_percentile(const struct hist *h, double percent)
+{
+    if (!h->count) return 0;
+
+    double exact = percent / 100.0 * h->count;
+    unsigned long long target = (unsigned long long)exact;
+    unsigned long long seen = 0;
+
+    if (target < exact) target++;
+    if (target < 1) target = 1;
+    if (target > h->count) target = h->count;
+
+    for (unsigned int i = 0; i < h->nr_buckets; i++)
+    {
+        seen += h->buckets[i];
+        if (seen >= target)
+        {
+            unsigned long long top = bucket_top(h->sub_bits, i);
+            return top < h->max ? top : h->max;
+        }
+    }
+
+    return h->max;
+}
@@ -0,0 +1,61 @@
+#ifndef _HISTOGRAM_H
+#define _HISTOGRAM_H
+#include <stddef.h>
+
+/*
+    Log-linear (HDR-style) histogram of non-negative integer values.
+
+    Values below 2^sub_bits get a bucket each. Above that, every power of
+    two is split into 2^sub_bits equal buckets, so a value is known to
+    within 1 / 2^sub_bits of itself. Values are clamped to HIST_MAX_VALUE.
+    Recording is a count-leading-zeros and an increment. The buckets are
+    part of the object (see hist_size), nothing is allocated after init.
+*/
+#define HIST_MAX_BITS       32
+#define HIST_MAX_VALUE      ((1ULL << HIST_MAX_BITS) - 1)
+
+struct hist
+{
+    unsigned long long count;
+    unsigned long long sum;
+    unsigned long long max;
+    unsigned int sub_bits;
+    unsigned int nr_buckets;
+    unsigned int buckets[];
+};
+
+static inline unsigned int hist_nr_buckets(unsigned int sub_bits)
+{
+    return (HIST_MAX_BITS + 1 - sub_bits) << sub_bits;
+}
+
+static inline size_t hist_size(unsigned int sub_bits)
+{
+    return sizeof(struct hist) + hist_nr_buckets(sub_bits) * sizeof(unsigned int);
+}
+
+void hist_init(struct hist *h, unsigned int sub_bits);
+// value that percent % of the samples are at or below, as the top of its
+// bucket (but never above the largest sample)
+unsigned long long hist_percentile(const struct hist *h, double percent);
+
+static inline unsigned int hist_index(unsigned int sub_bits, unsigned long long v)
+{
+    if (v < (1ULL << sub_bits)) return (unsigned int)v;
+
+    int shift = 63 - __builtin_clzll(v) - sub_bits;
+    return ((unsigned int)(shift + 1) << sub_bits) + (unsigned int)(v >> shift) - (1u << sub_bits);
+}
+
+static inline void hist_record(struct hist *h, long long value)
+{
+    unsigned long long v = value < 0 ? 0 : (unsigned long long)value;
+    if (v > HIST_MAX_VALUE) v = HIST_MAX_VALUE;
+
+    h->buckets[hist_index(h->sub_bits, v)]++;
+    h->count++;
+    h->sum += v;
+    if (v > h->max) h->max = v;
+}
+
+#endif
@@ -1,19 +1,23 @@
 #include <stddef.h>
 #include <stdlib.h>
-#include "avl.h"
+#include "task.h"
 #include "map.h"
+#include "swissmap.h"
+#include "tracepoint.h"
 #include <stdio.h>
 
 #define LOAD_FACTOR_THRESHOLD    (0.7f)
+#define MIN_TABLE_SIZE           (16)
 
-int hash_key(struct hash *hash, long long key)
+// Fibonacci hashing: one multiply, the high bits are well mixed
+static unsigned long long hash_key(long long key)
 {
-    return key % hash->table_size;
+    return (unsigned long long)key * 0x9E3779B97F4A7C15ULL;
 }
 
-static int hash2(struct hash *map, long long key)
+static inline long long home_slot(struct hash *map, long long key)
 {
-    return 1 + (map->hash_fn(map, key) % (map->table_size - 1));
+    return (long long)(map->hash_fn(key) >> map->shift);
 }
 
 static inline void update_load_factor(struct hash *map)
@@ -22,30 +26,46 @@ static inline void update_load_factor(struct hash *map)
     map->load_factor = (float)map->num_of_elements / map->table_size;
 }
 
-static char isPrime(long long i)
+static long long next_pow2(long long n)
 {
-    if (i <= 1) return 0;
-    if (i == 2) return 1;
-    if (i % 2 == 0) return 0;
+    long long size = MIN_TABLE_SIZE;
+    while (size < n) size <<= 1;
+    return size;
+}
 
-    for (size_t j = 3; j * j <= i; j++)
+static int log2_of(long long size)
+{
+    return 63 - __builtin_clzll((unsigned long long)size);
+}
+
+static int table_alloc(struct hash *map, long long size)
+{
+    struct key_value_pair *slots = calloc(size, sizeof(struct key_value_pair));
+    if (!slots)
     {
-        if (i % j == 0) return 0;
+        #ifdef DEBUG
+        fprintf(stderr, "hash alloc failed!\n");
+        #endif
+        return -1;
     }
 
-    return 1; // no number below its sqrt is divisible
+    map->hashmap = slots;
+    map->table_size = size;
+    map->mask = size - 1;
+    map->shift = 64 - log2_of(size);
+    return 0;
 }
 
-static long long getPrime(long long start)
+int map_init(struct hash **hash, long long no_of_slots,
+    unsigned long long (*hash_fn)(long long key)) 
 {
-    while (!isPrime(start)) start++;
-    return start;
+    return map_init_mode(hash, no_of_slots, hash_fn, MAP_LINEAR);
 }
 
-int map_init(struct hash **hash, long long no_of_slots,
-    int (*hash_fn)(struct hash *hash, long long key)) 
+int map_init_mode(struct hash **hash, long long no_of_slots,
+    unsigned long long (*hash_fn)(long long key), enum map_mode mode) 
 {    
-    long long taken_table_size = getPrime(no_of_slots);
+    long long taken_table_size = next_pow2(no_of_slots);
     #ifdef DEBUG
     fprintf(stdout, "Taken table size is %lld\n", taken_table_size);
     #endif
@@ -59,17 +79,15 @@ int map_init(struct hash **hash, long long no_of_slots,
         return -1;
     }
 
-    (*hash)->hashmap = (struct key_value_pair **) calloc(taken_table_size, sizeof(struct key_value_pair *));
-    if (!(*hash)->hashmap) 
+    (*hash)->mode = mode;
+    if ((mode == MAP_SWISS ? swiss_init(*hash, taken_table_size) : table_alloc(*hash, taken_table_size)) < 0)
     {
-        #ifdef DEBUG
-        fprintf(stderr, "hash alloc failed!");
-        #endif
+        free_wrapper(*hash, "map_init");
+        *hash = NULL;
         return -1;
     }
 
     (*hash)->num_of_elements = 0;
-    (*hash)->table_size = taken_table_size;
     (*hash)->load_factor = 0.0f;
     (*hash)->hash_fn = hash_fn;
     if (!hash_fn)
@@ -83,67 +101,44 @@ int map_init(struct hash **hash, long long no_of_slots,
 }
 
 /*
-    Double hashing uses a hash for start index another has for step increment
-    important thigs is the step is a coprime with table size 
-    this is done by taking the table size - 1 modulo
-    coprime ensures that all slots are vistied on a linear probe
-
-    index = (hash1(key) + i*hash2(key)) %  table_size
-    hash1(key) = key % table_size
-    hash2(key) = 1 + (hash1(key) % N-1) => modulo N-1 ensure 0..N-2 range +1 is to avoid infinite loop / mov ethe step so 1..N-1 (no 0, causes loop) 
+    Linear probing from home_slot(key). A lookup stops at the first free
+    slot, which stays correct because deletes never leave holes inside a
+    cluster (see map_delete).
 */
 
-static struct hash *rehash(struct hash *map)
+// slot holding key, or the free slot where it would go
+static long long find_slot(struct hash *map, long long key)
 {
-    long long cur_size = map->table_size;
-    long long new_size = getPrime(cur_size * 2);
+    long long index = home_slot(map, key);
 
-    struct hash *newmap = (struct hash *)calloc(1, sizeof(struct hash));
-    if (!newmap) 
+    while (map->hashmap[index].val && map->hashmap[index].key != key)
     {
-        #ifdef DEBUG
-        fprintf(stderr, "rehash alloc failed!\n");
-        #endif
-        return NULL;
+        index = (index + 1) & map->mask;
     }
 
-    newmap->hashmap = (struct key_value_pair **)calloc(new_size, sizeof(struct key_value_pair *));
-    if (!newmap->hashmap) 
-    {
-        #ifdef DEBUG
-        fprintf(stderr, "rehash alloc failed!\n");
-        #endif
-        free_wrapper(newmap, "rehash");
-        return NULL;
-    }
-    newmap->table_size = new_size;
-    newmap->hash_fn = map->hash_fn;
+    return index;
+}
+
+static int rehash(struct hash *map)
+{
+    struct key_value_pair *old = map->hashmap;
+    long long cur_size = map->table_size;
 
-    for (size_t i = 0; i < cur_size; i++) 
+    if (table_alloc(map, cur_size * 2) < 0) return -1;
+    tp_fire(TP_REHASH, -1, cur_size, cur_size * 2);
+
+    for (long long i = 0; i < cur_size; i++) 
     {
-        struct key_value_pair *entry = map->hashmap[i];
-        if (entry && entry != TOMBSTONE) 
+        if (old[i].val) 
         {
-            long long key = entry->key;
-            // probe into new table until empty slot
-            for (long long j = 0; j < new_size; j++) 
-            {
-                long long index = ((long long)newmap->hash_fn(newmap, key) + j * hash2(newmap, key)) % new_size;
-                if (!newmap->hashmap[index]) 
-                {
-                    newmap->hashmap[index] = entry; // move pointer directly
-                    newmap->num_of_elements++;
-                    break;
-                }
-            }
+            map->hashmap[find_slot(map, old[i].key)] = old[i];
         }
     }
 
-    // free only the old table array, not the key_value_pair structs
-    free_wrapper(map->hashmap, "rehashed");
-    free_wrapper(map, "rehashed");
+    free_wrapper(old, "rehashed");
+    update_load_factor(map);
 
-    return newmap;
+    return 0;
 }
 
 struct task *map_lookup(struct hash **hash, long long key)
@@ -157,23 +152,9 @@ struct task *map_lookup(struct hash **hash, long long key)
     }
 
     struct hash *map = *hash;
-    for (long long i = 0; i < map->table_size; i++) 
-    {
-        long long index = ((long long)map->hash_fn(map, key) + i * hash2(map, key)) % map->table_size;
-
-        if (!map->hashmap[index]) return NULL;
-        else if (map->hashmap[index] == TOMBSTONE) continue;
-        else if (map->hashmap[index]->key == key)
-        {
-            return map->hashmap[index]->val;
-        }
-        else
-        {
-            // continue probe
-        }
-    }
+    if (map->mode == MAP_SWISS) return swiss_lookup(map, key);
 
-    return NULL;
+    return map->hashmap[find_slot(map, key)].val;
 }
 void free_wrapper(void * p, const char *owner)
 {
@@ -185,15 +166,9 @@ void free_wrapper(void * p, const char *owner)
 
 void free_map(struct hash *map)
 {
-    for (size_t i = 0; i < map->table_size; i++) 
-    {
-        if (map->hashmap[i] && map->hashmap[i] != TOMBSTONE) 
-        {
-            free_wrapper(map->hashmap[i], "free_map: i");
-        }
-    }
     if (map)
     {
+        if (map->mode == MAP_SWISS) swiss_free(map);
         free_wrapper(map->hashmap, "free_map: table");
         free_wrapper(map, "free_map: p");
     }
@@ -201,7 +176,7 @@ void free_map(struct hash *map)
 
 void map_insert(struct hash **hash, long long key, struct task *val)
 {
-    if (!hash || !*hash) 
+    if (!hash || !*hash || !val) 
     {
         #ifdef DEBUG
         fprintf(stderr, "invalid pointer\n");
@@ -210,37 +185,42 @@ void map_insert(struct hash **hash, long long key, struct task *val)
     }
 
     struct hash *map = *hash;
-    for (long long i = 0; i < map->table_size; i++) 
+    if (map->mode == MAP_SWISS)
     {
-        long long index = ((long long)map->hash_fn(map, key) + i * hash2(map, key)) % map->table_size;
+        swiss_insert(map, key, val);
+        update_load_factor(map);
+        return;
+    }
 
-        if (!map->hashmap[index] || map->hashmap[index] == TOMBSTONE)
-        {
-            struct key_value_pair *n = (struct key_value_pair *) malloc(sizeof(struct key_value_pair));
-            n->val = val;
-            n->key = key;
-            map->hashmap[index] = n;
-            map->num_of_elements++;
-            
-            update_load_factor(map);
-            if (map->load_factor > LOAD_FACTOR_THRESHOLD)
-            {
-                struct hash *new_hash = rehash(map);
-                if (new_hash)
-                {
-                    *hash = new_hash;
-                }
-            }
-            break;
-        }
-        else if (map->hashmap[index] && map->hashmap[index]->key == key) // overwrite
-        {
-            map->hashmap[index]->val = val;
-            break;
-        }
+    long long index = find_slot(map, key);
+
+    if (map->hashmap[index].val) // overwrite
+    {
+        map->hashmap[index].val = val;
+        return;
+    }
+
+    map->hashmap[index].key = key;
+    map->hashmap[index].val = val;
+    map->num_of_elements++;
+
+    update_load_factor(map);
+    if (map->load_factor > LOAD_FACTOR_THRESHOLD)
+    {
+        #ifdef DEBUG
+        if (rehash(map) < 0) fprintf(stderr, "rehash failed, staying at %lld slots\n", map->table_size);
+        #else
+        rehash(map);
+        #endif
     }
 }
 
+/*
+    Backward-shift delete: walk the cluster after the freed slot and pull
+    back every entry whose home slot is not between the hole and itself
+    (cyclically). The hole moves to that entry's old slot and the walk
+    continues until a free slot ends the cluster.
+*/
 void map_delete(struct hash **hash, long long key)
 {
     if (!hash || !*hash) 
@@ -252,30 +232,33 @@ void map_delete(struct hash **hash, long long key)
     }
 
     struct hash *map = *hash;
-    for (long long i = 0; i < map->table_size; i++) 
+    if (map->mode == MAP_SWISS)
     {
-        long long index = ((long long)map->hash_fn(map, key) + i * hash2(map, key)) % map->table_size;
-
-        if (!map->hashmap[index]) return; // key not found
-        if (map->hashmap[index] == TOMBSTONE) continue;
-        if (map->hashmap[index]->key == key) 
-        {
-            free_wrapper(map->hashmap[index], "Map delete");
-            map->hashmap[index] = TOMBSTONE;
-            map->num_of_elements--;
-            update_load_factor(map);
-            return;
-        }
+        swiss_delete(map, key);
+        update_load_factor(map);
+        return;
     }
-}
 
-void map_print_all(struct hash *hash)
-{
-    for (long long i = 0; i < hash->table_size; i++)
+    long long hole = find_slot(map, key);
+
+    if (!map->hashmap[hole].val) return; // key not found
+
+    long long index = hole;
+    for (;;)
     {
-        if (hash->hashmap[i] && hash->hashmap[i] != TOMBSTONE)
+        index = (index + 1) & map->mask;
+        if (!map->hashmap[index].val) break;
+
+        long long home = home_slot(map, map->hashmap[index].key);
+        // distance from home must cover the hole for the entry to move back
+        if (((index - home) & map->mask) >= ((index - hole) & map->mask))
         {
-            fprintf(stdout, "Map contents: key %lld value %p\n", hash->hashmap[i]->key, hash->hashmap[i]->val);
+            map->hashmap[hole] = map->hashmap[index];
+            hole = index;
         }
     }
-}
\ No newline at end of file
+
+    map->hashmap[hole].val = NULL;
+    map->num_of_elements--;
+    update_load_factor(map);
+}
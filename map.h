@@ -1,32 +1,53 @@
-
 #ifndef _MAP_H
 #define _MAP_H
+#include <stdio.h>
 
+/*
+    Open-addressed pid -> task map. Slots are stored inline (no per-entry
+    allocation), the table is a power of two probed linearly from a
+    multiplicative hash, and deletes shift the following cluster back, so
+    there are no tombstones and probe lengths only depend on live load.
+    A slot is free when its val is NULL.
 
-#define TOMBSTONE                ((void *)-1)
-struct hash 
+    MAP_SWISS switches the same API to a Swiss-table layout (swissmap.c):
+    slots come in groups of 16 with a control byte each, and a lookup
+    matches a 7-bit hash tag against a whole group with one SIMD compare.
+*/
+enum map_mode
 {
-    struct key_value_pair **hashmap;
-    long long num_of_elements;
-    long long table_size;
-    float load_factor;
-    int (*hash_fn)(struct hash *hash, long long key);
+    MAP_LINEAR = 0,
+    MAP_SWISS,
 };
+
 struct key_value_pair 
 {
     long long key;
     struct task *val;
 };
 
+struct hash 
+{
+    struct key_value_pair *hashmap;
+    long long num_of_elements;
+    long long table_size;       // always a power of two
+    long long mask;
+    int shift;                  // 64 - log2(table_size)
+    float load_factor;
+    unsigned long long (*hash_fn)(long long key);
+    enum map_mode mode;
+    signed char *ctrl;          // MAP_SWISS: one control byte per slot
+    long long nr_deleted;       // MAP_SWISS: DELETED control bytes
+};
+
 
 int map_init(struct hash **hash, long long no_of_slots,
-    int (*hash_fn)(struct hash *hash, long long key)) ;
+    unsigned long long (*hash_fn)(long long key)) ;
+int map_init_mode(struct hash **hash, long long no_of_slots,
+    unsigned long long (*hash_fn)(long long key), enum map_mode mode);
 struct task *map_lookup(struct hash **hash, long long key);
 void map_insert(struct hash **hash, long long key, struct task *val);
 void map_delete(struct hash **hash, long long key);
-struct task *map_lookup(struct hash **hash, long long key);
 void free_map(struct hash *map);
 void free_wrapper(void * p, const char *owner);
-void map_print_all(struct hash *hash);
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,125 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "map.h"
+
+/*
+    Wake-map micro benchmark: MAP_LINEAR against MAP_SWISS.
+
+    For each population size it fills the map with pid-like keys, then
+    times random hits, random misses and sleep/wake churn (delete a key,
+    put it back), the pattern WAKEUP/EXIT put on wake_queue_task_map.
+
+    gcc -O2 -o map_bench map_bench.c map.c swissmap.c tracepoint.c
+    ./map_bench [population ...]
+*/
+
+#define OPS    (4 * 1000 * 1000)
+
+static unsigned long long rng_state = 0x2545F4914F6CDD1DULL;
+
+static unsigned long long xorshift64(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void run(enum map_mode mode, long long population, long long *keys, long long *probes)
+{
+    struct hash *map = NULL;
+    volatile long long sink = 0;
+
+    if (map_init_mode(&map, 11, NULL, mode) < 0)
+    {
+        fprintf(stderr, "map_init failed\n");
+        exit(1);
+    }
+
+    double t0 = now_ns();
+    for (long long i = 0; i < population; i++)
+    {
+        map_insert(&map, keys[i], (struct task *)(keys + i));
+    }
+    double t1 = now_ns();
+
+    for (long long i = 0; i < OPS; i++)
+    {
+        sink += map_lookup(&map, keys[probes[i]]) != NULL;
+    }
+    double t2 = now_ns();
+
+    // odd keys were never inserted
+    for (long long i = 0; i < OPS; i++)
+    {
+        sink += map_lookup(&map, keys[probes[i]] + 1) != NULL;
+    }
+    double t3 = now_ns();
+
+    for (long long i = 0; i < OPS; i++)
+    {
+        long long k = keys[probes[i]];
+        map_delete(&map, k);
+        map_insert(&map, k, (struct task *)(keys + probes[i]));
+    }
+    double t4 = now_ns();
+
+    printf("%-8s %10lld %10.1f %10.1f %10.1f %10.1f %12lld\n",
+        mode == MAP_SWISS ? "swiss" : "linear", population,
+        (t1 - t0) / population, (t2 - t1) / OPS, (t3 - t2) / OPS, (t4 - t3) / OPS,
+        map->table_size);
+
+    free_map(map);
+    (void)sink;
+}
+
+int main(int argc, char **argv)
+{
+    long long defaults[] = { 1000, 100000, 1000000, 4000000 };
+    int nr_sizes = argc > 1 ? argc - 1 : (int)(sizeof(defaults) / sizeof(defaults[0]));
+
+    printf("%-8s %10s %10s %10s %10s %10s %12s\n",
+        "map", "tasks", "insert_ns", "hit_ns", "miss_ns", "churn_ns", "slots");
+
+    for (int s = 0; s < nr_sizes; s++)
+    {
+        long long population = argc > 1 ? atoll(argv[s + 1]) : defaults[s];
+        if (population <= 0) continue;
+
+        long long *keys = malloc(population * sizeof(long long));
+        long long *probes = malloc(OPS * sizeof(long long));
+        if (!keys || !probes)
+        {
+            fprintf(stderr, "out of memory\n");
+            return 1;
+        }
+
+        // pids grow with small gaps, always even so key + 1 is a miss
+        long long pid = 2;
+        for (long long i = 0; i < population; i++)
+        {
+            keys[i] = pid;
+            pid += 2 * (1 + xorshift64() % 4);
+        }
+        for (long long i = 0; i < OPS; i++)
+        {
+            probes[i] = xorshift64() % population;
+        }
+
+        run(MAP_LINEAR, population, keys, probes);
+        run(MAP_SWISS, population, keys, probes);
+
+        free(keys);
+        free(probes);
+    }
+
+    return 0;
+}
@@ -0,0 +1,292 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "output.h"
+#include "trace.h"
+
+#define OUT_MAX_RECORD      256     // longest record in any format
+
+static const char *out_format_names[] = {
+    [OUT_TEXT]   = "text",
+    [OUT_NONE]   = "none",
+    [OUT_CSV]    = "csv",
+    [OUT_BINARY] = "binary",
+};
+
+static const char *out_kind_names[OUT_NR_KINDS] = {
+    [OUT_EVENT]  = "event",
+    [OUT_START]  = "start",
+    [OUT_WAKEUP] = "wakeup",
+    [OUT_SLICE]  = "slice",
+    [OUT_EXIT]   = "exit",
+};
+
+int out_format_parse(const char *name)
+{
+    for (size_t i = 0; i < sizeof(out_format_names) / sizeof(out_format_names[0]); i++)
+    {
+        if (strcmp(name, out_format_names[i]) == 0) return i;
+    }
+
+    return -1;
+}
+
+static inline void put_str(struct output *o, const char *s)
+{
+    size_t n = strlen(s);
+    memcpy(o->buf + o->len, s, n);
+    o->len += n;
+}
+
+static inline void put_char(struct output *o, char c)
+{
+    o->buf[o->len++] = c;
+}
+
+static inline void put_ll(struct output *o, long long v)
+{
+    char tmp[24];
+    int n = 0;
+    unsigned long long u = v < 0 ? 0ULL - (unsigned long long)v : (unsigned long long)v;
+
+    do
+    {
+        tmp[n++] = '0' + u % 10;
+        u /= 10;
+    } while (u);
+
+    if (v < 0) put_char(o, '-');
+    while (n) put_char(o, tmp[--n]);
+}
+
+void out_flush(struct output *o)
+{
+    // the buffer is the writer thread's while a pipeline runs
+    if (o->ring)
+    {
+        spsc_flush(o->ring);
+        return;
+    }
+
+    if (o->len)
+    {
+        fwrite(o->buf, 1, o->len, o->f);
+        o->len = 0;
+    }
+}
+
+int out_open(struct output *o, enum out_format format, FILE *f, int show_cpu)
+{
+    memset(o, 0, sizeof(*o));
+    o->format = format;
+    o->f = f;
+    o->show_cpu = show_cpu;
+
+    if (format == OUT_NONE) return 0;
+
+    o->buf = malloc(OUT_BUF_SIZE);
+    if (!o->buf)
+    {
+        #ifdef DEBUG
+        fprintf(stderr, "output buffer alloc failed\n");
+        #endif
+        return -1;
+    }
+
+    if (format == OUT_CSV)
+    {
+        put_str(o, "time,kind,action,cpu,pid,arg,vruntime,remaining\n");
+    }
+    else if (format == OUT_BINARY)
+    {
+        unsigned int header[2] = { sizeof(struct out_record), 0 };
+        memcpy(o->buf, OUT_MAGIC, 8);
+        memcpy(o->buf + 8, header, sizeof(header));
+        o->len = 8 + sizeof(header);
+    }
+
+    return 0;
+}
+
+void out_close(struct output *o)
+{
+    if (o->buf)
+    {
+        out_flush(o);
+        fflush(o->f);
+        free(o->buf);
+        o->buf = NULL;
+    }
+}
+
+static void put_prefix(struct output *o, long long time, int cpu)
+{
+    put_str(o, "[TIME ");
+    put_ll(o, time);
+    put_str(o, "] ");
+    if (o->show_cpu && cpu >= 0)
+    {
+        put_str(o, "CPU=");
+        put_ll(o, cpu);
+        put_char(o, ' ');
+    }
+    put_str(o, "PID=");
+}
+
+/*
+    CSV and binary records. Fields that do not apply to the kind are
+    already 0 in r: CSV leaves them empty, binary writes the zeros.
+*/
+static void put_record(struct output *o, const struct out_record *r)
+{
+    int has_arg = r->kind == OUT_EVENT || r->kind == OUT_START || r->kind == OUT_SLICE;
+    int has_vr = r->kind == OUT_WAKEUP || r->kind == OUT_SLICE;
+
+    if (o->format == OUT_BINARY)
+    {
+        memcpy(o->buf + o->len, r, sizeof(*r));
+        o->len += sizeof(*r);
+        return;
+    }
+
+    put_ll(o, r->time);
+    put_char(o, ',');
+    put_str(o, out_kind_names[r->kind]);
+    put_char(o, ',');
+    if (r->kind == OUT_EVENT) put_str(o, trace_action_name(r->action));
+    put_char(o, ',');
+    if (r->cpu >= 0) put_ll(o, r->cpu);
+    put_char(o, ',');
+    put_ll(o, r->pid);
+    put_char(o, ',');
+    if (has_arg) put_ll(o, r->arg);
+    put_char(o, ',');
+    if (has_vr) put_ll(o, r->vruntime);
+    put_char(o, ',');
+    if (has_vr) put_ll(o, r->remaining);
+    put_char(o, '\n');
+}
+
+// formats r into the buffer, on whichever thread owns it
+void out_write_record(struct output *o, const struct out_record *r)
+{
+    if (o->len + OUT_MAX_RECORD > OUT_BUF_SIZE)
+    {
+        fwrite(o->buf, 1, o->len, o->f);
+        o->len = 0;
+    }
+
+    if (o->format != OUT_TEXT)
+    {
+        put_record(o, r);
+        return;
+    }
+
+    if (r->kind == OUT_EVENT)
+    {
+        put_str(o, "Process event: ");
+        put_ll(o, r->time);
+        put_char(o, ' ');
+        put_str(o, trace_action_name(r->action));
+        put_char(o, ' ');
+        put_ll(o, r->pid);
+        put_char(o, ' ');
+        put_ll(o, r->arg);
+        put_char(o, '\n');
+        return;
+    }
+
+    put_prefix(o, r->time, r->cpu);
+    put_ll(o, r->pid);
+
+    switch (r->kind) {
+    case OUT_START:
+        put_str(o, " STARTED (runtime=");
+        put_ll(o, r->arg);
+        put_str(o, ")\n");
+        break;
+    case OUT_WAKEUP:
+        put_str(o, " WOKE UP (vruntime=");
+        put_ll(o, r->vruntime);
+        put_str(o, ", remaining=");
+        put_ll(o, r->remaining);
+        put_str(o, ")\n");
+        break;
+    case OUT_SLICE:
+        put_str(o, " ran for ");
+        put_ll(o, r->arg);
+        put_str(o, " ms → new vruntime=");
+        put_ll(o, r->vruntime);
+        put_str(o, ", remaining=");
+        put_ll(o, r->remaining);
+        put_char(o, '\n');
+        break;
+    default:
+        put_str(o, " EXITED\n");
+        break;
+    }
+}
+
+// counts the record, then formats it here or hands it to the writer thread
+static inline void out_put(struct output *o, const struct out_record *r)
+{
+    o->records[r->kind]++;
+    if (o->format == OUT_NONE) return;
+
+    if (o->ring)
+    {
+        struct out_record *slot = spsc_slot(o->ring);
+        if (!slot) return;
+        *slot = *r;
+        spsc_push(o->ring);
+        return;
+    }
+
+    out_write_record(o, r);
+}
+
+void out_event(struct output *o, long long time, int action, long long pid, long long runtime)
+{
+    struct out_record r = {
+        .time = time, .pid = pid, .arg = runtime,
+        .kind = OUT_EVENT, .action = action < 0 ? 0xff : action, .cpu = -1,
+    };
+    out_put(o, &r);
+}
+
+void out_start(struct output *o, long long time, int cpu, long long pid, long long runtime)
+{
+    struct out_record r = {
+        .time = time, .pid = pid, .arg = runtime,
+        .kind = OUT_START, .action = 0xff, .cpu = cpu,
+    };
+    out_put(o, &r);
+}
+
+void out_wakeup(struct output *o, long long time, int cpu, long long pid, long long vruntime, long long remaining)
+{
+    struct out_record r = {
+        .time = time, .pid = pid, .vruntime = vruntime, .remaining = remaining,
+        .kind = OUT_WAKEUP, .action = 0xff, .cpu = cpu,
+    };
+    out_put(o, &r);
+}
+
+void out_slice(struct output *o, long long time, int cpu, long long pid, long long slice,
+    long long vruntime, long long remaining)
+{
+    struct out_record r = {
+        .time = time, .pid = pid, .arg = slice, .vruntime = vruntime, .remaining = remaining,
+        .kind = OUT_SLICE, .action = 0xff, .cpu = cpu,
+    };
+    out_put(o, &r);
+}
+
+void out_exit(struct output *o, long long time, int cpu, long long pid)
+{
+    struct out_record r = {
+        .time = time, .pid = pid,
+        .kind = OUT_EXIT, .action = 0xff, .cpu = cpu,
+    };
+    out_put(o, &r);
+}
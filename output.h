@@ -0,0 +1,80 @@
+#ifndef _OUTPUT_H
+#define _OUTPUT_H
+#include <stdio.h>
+#include <stddef.h>
+#include "spsc.h"
+
+/*
+    Event-log sink. Records are formatted by hand into a large buffer that
+    is written out in one fwrite whenever it fills up, instead of one
+    fprintf per line.
+
+        OUT_TEXT    the classic "[TIME t] PID=..." log
+        OUT_NONE    nothing, only the records are counted
+        OUT_CSV     time,kind,action,cpu,pid,arg,vruntime,remaining
+        OUT_BINARY  "CFSOUT01" | u32 record size | u32 reserved, then one
+                    struct out_record per record, native byte order
+
+    arg is the runtime for event/start records and the slice length for
+    slice records. Fields that do not apply are empty in CSV and 0 in
+    binary, cpu is -1 when not known.
+*/
+enum out_format
+{
+    OUT_TEXT = 0,
+    OUT_NONE,
+    OUT_CSV,
+    OUT_BINARY,
+};
+
+enum out_kind
+{
+    OUT_EVENT = 0,      // a trace event as it is read
+    OUT_START,
+    OUT_WAKEUP,
+    OUT_SLICE,          // a task ran for arg ms
+    OUT_EXIT,
+    OUT_NR_KINDS,
+};
+
+#define OUT_MAGIC           "CFSOUT01"
+#define OUT_BUF_SIZE        (1 << 20)
+
+struct out_record
+{
+    long long time;
+    long long pid;
+    long long arg;
+    long long vruntime;
+    long long remaining;
+    unsigned char kind;
+    unsigned char action;
+    short cpu;
+    int reserved;
+};
+
+struct output
+{
+    enum out_format format;
+    FILE *f;
+    int show_cpu;                   // OUT_TEXT: tag lines with CPU=n
+    char *buf;
+    size_t len;
+    unsigned long long records[OUT_NR_KINDS];
+    struct spsc_ring *ring;         // -pipeline: records go to the writer thread, see pipeline.h
+};
+
+int out_format_parse(const char *name);
+int out_open(struct output *o, enum out_format format, FILE *f, int show_cpu);
+void out_flush(struct output *o);
+void out_close(struct output *o);
+void out_write_record(struct output *o, const struct out_record *r);
+
+void out_event(struct output *o, long long time, int action, long long pid, long long runtime);
+void out_start(struct output *o, long long time, int cpu, long long pid, long long runtime);
+void out_wakeup(struct output *o, long long time, int cpu, long long pid, long long vruntime, long long remaining);
+void out_slice(struct output *o, long long time, int cpu, long long pid, long long slice,
+    long long vruntime, long long remaining);
+void out_exit(struct output *o, long long time, int cpu, long long pid);
+
+#endif
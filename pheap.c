@@ -0,0 +1,150 @@
+#include <stddef.h>
+#include <stdlib.h>
+#include "pheap.h"
+#include "runqueue.h"
+
+// both a and b must be detached roots (no parent, no sibling)
+static struct task *meld(struct pheap *heap, struct task *a, struct task *b)
+{
+    if (!a) return b;
+    if (!b) return a;
+
+    heap->links++;
+
+    if (task_compare(b, a) < 0)
+    {
+        struct task *tmp = a;
+        a = b;
+        b = tmp;
+    }
+
+    // b becomes the first child of a
+    b->parent = a;
+    b->right  = a->left;
+    if (a->left) a->left->parent = b;
+    a->left = b;
+
+    return a;
+}
+
+/*
+    Standard two-pass combine of a sibling list: meld pairs left to right,
+    then fold the results right to left. Iterative, the first pass keeps
+    its results on a stack threaded through ->right.
+*/
+static struct task *merge_pairs(struct pheap *heap, struct task *first)
+{
+    struct task *stack = NULL;
+
+    while (first)
+    {
+        struct task *a = first;
+        struct task *b = a->right;
+        first = b ? b->right : NULL;
+
+        a->right = a->parent = NULL;
+        if (b) b->right = b->parent = NULL;
+
+        struct task *m = meld(heap, a, b);
+        m->right = stack;
+        stack = m;
+    }
+
+    struct task *result = NULL;
+    while (stack)
+    {
+        struct task *next = stack->right;
+        stack->right = NULL;
+        result = meld(heap, stack, result);
+        stack = next;
+    }
+
+    return result;
+}
+
+void pheap_insert(struct pheap *heap, struct task *node)
+{
+    node->left = node->right = node->parent = NULL;
+    heap->root = meld(heap, heap->root, node);
+}
+
+struct task *pheap_pop_min(struct pheap *heap)
+{
+    struct task *min = heap->root;
+    if (!min) return NULL;
+
+    heap->root = merge_pairs(heap, min->left);
+    min->left = NULL;
+
+    return min;
+}
+
+void pheap_remove(struct pheap *heap, struct task *node)
+{
+    if (node == heap->root)
+    {
+        pheap_pop_min(heap);
+        return;
+    }
+
+    // unlink node from its sibling list
+    if (node->parent->left == node) node->parent->left = node->right;
+    else node->parent->right = node->right;
+    if (node->right) node->right->parent = node->parent;
+    node->right = node->parent = NULL;
+
+    struct task *sub = merge_pairs(heap, node->left);
+    node->left = NULL;
+
+    heap->root = meld(heap, heap->root, sub);
+}
+
+static int pheap_rq_init(struct run_queue *rq)
+{
+    rq->pheap.root = NULL;
+    rq->pheap.links = 0;
+    return 0;
+}
+
+static void pheap_rq_insert(struct run_queue *rq, struct task *t)
+{
+    pheap_insert(&rq->pheap, t);
+}
+
+static void pheap_rq_remove(struct run_queue *rq, struct task *t)
+{
+    pheap_remove(&rq->pheap, t);
+}
+
+static struct task *pheap_rq_peek_min(struct run_queue *rq)
+{
+    return pheap_min(&rq->pheap);
+}
+
+static struct task *pheap_rq_pop_min(struct run_queue *rq)
+{
+    return pheap_pop_min(&rq->pheap);
+}
+
+static unsigned long long pheap_rq_restructures(struct run_queue *rq)
+{
+    return rq->pheap.links;
+}
+
+static void pheap_rq_visit(struct run_queue *rq, struct rq_visitor *v)
+{
+    v->ptr(v, &rq->pheap.root);
+    v->word(v, &rq->pheap.links);
+}
+
+const struct rq_ops pheap_rq_ops = {
+    .name         = "pheap",
+    .init         = pheap_rq_init,
+    .destroy      = NULL,
+    .insert       = pheap_rq_insert,
+    .remove       = pheap_rq_remove,
+    .peek_min     = pheap_rq_peek_min,
+    .pop_min      = pheap_rq_pop_min,
+    .restructures = pheap_rq_restructures,
+    .visit        = pheap_rq_visit,
+};
@@ -0,0 +1,25 @@
+#ifndef _PHEAP_H
+#define _PHEAP_H
+#include "task.h"
+
+/*
+    Pairing heap in left-child / right-sibling form: task->left is the
+    first child, task->right the next sibling and task->parent the
+    previous sibling (or the parent, for a first child).
+*/
+struct pheap
+{
+    struct task *root;
+    unsigned long long links;   // number of melds, the heap's restructuring cost
+};
+
+void pheap_insert(struct pheap *heap, struct task *node);
+void pheap_remove(struct pheap *heap, struct task *node);
+struct task *pheap_pop_min(struct pheap *heap);
+
+static inline struct task *pheap_min(struct pheap *heap)
+{
+    return heap->root;
+}
+
+#endif
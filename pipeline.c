@@ -0,0 +1,109 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "pipeline.h"
+
+static void *reader_thread(void *arg)
+{
+    struct pipeline *p = arg;
+    struct input *in;
+    int ret = 0;
+
+    // the simulation closes events itself if it stops early
+    while ((in = spsc_slot(p->events)))
+    {
+        ret = trace_next(p->trace, in);
+        if (ret <= 0) break;
+        spsc_push(p->events);
+    }
+
+    p->trace_status = ret;
+    spsc_flush(p->events);
+    spsc_close(p->events);
+    return NULL;
+}
+
+static void *writer_thread(void *arg)
+{
+    struct pipeline *p = arg;
+    const struct out_record *r;
+
+    while ((r = spsc_front(p->records)))
+    {
+        out_write_record(p->out, r);
+        spsc_pop(p->records);
+    }
+
+    out_flush(p->out);
+    return NULL;
+}
+
+struct pipeline *pipe_start(struct trace_reader *trace, struct output *out)
+{
+    struct pipeline *p = calloc(1, sizeof(*p));
+    if (!p) return NULL;
+
+    p->trace = trace;
+    p->out = out;
+    p->events = spsc_create(sizeof(struct input), PIPE_EVENT_SLOTS);
+    if (out->format != OUT_NONE) p->records = spsc_create(sizeof(struct out_record), PIPE_RECORD_SLOTS);
+
+    if (!p->events || (out->format != OUT_NONE && !p->records))
+    {
+        pipe_stop(p);
+        return NULL;
+    }
+
+    if (p->records)
+    {
+        // whatever out_open put in the buffer goes first
+        out_flush(out);
+        if (pthread_create(&p->writer, NULL, writer_thread, p) != 0)
+        {
+            pipe_stop(p);
+            return NULL;
+        }
+        p->has_writer = 1;
+        out->ring = p->records;
+    }
+
+    if (pthread_create(&p->reader, NULL, reader_thread, p) != 0)
+    {
+        pipe_stop(p);
+        return NULL;
+    }
+    p->has_reader = 1;
+    return p;
+}
+
+int pipe_next_event(struct pipeline *p, struct input *in)
+{
+    const struct input *e = spsc_front(p->events);
+
+    if (!e) return p->trace_status;
+    *in = *e;
+    spsc_pop(p->events);
+    return 1;
+}
+
+void pipe_stop(struct pipeline *p)
+{
+    if (p->has_reader)
+    {
+        spsc_close(p->events);
+        pthread_join(p->reader, NULL);
+    }
+
+    if (p->has_writer)
+    {
+        // the buffer goes back before the close, so the writer's last
+        // out_flush writes it out
+        p->out->ring = NULL;
+        spsc_flush(p->records);
+        spsc_close(p->records);
+        pthread_join(p->writer, NULL);
+    }
+
+    spsc_destroy(p->events);
+    spsc_destroy(p->records);
+    free(p);
+}
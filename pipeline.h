@@ -0,0 +1,46 @@
+#ifndef _PIPELINE_H
+#define _PIPELINE_H
+#include <pthread.h>
+#include "spsc.h"
+#include "trace.h"
+#include "output.h"
+
+#define PIPE_EVENT_SLOTS    4096
+#define PIPE_RECORD_SLOTS   16384
+
+/*
+    -pipeline: the trace is decoded and the log formatted and written on
+    threads of their own, so the simulation thread only schedules.
+
+        reader      trace_next() straight into the events ring
+        simulation  pops its next event off the events ring and pushes
+                    each log record, unformatted, onto the records ring
+        writer      formats the records in order into the output's own
+                    buffer and writes it out
+
+    Both rings are SPSC (spsc.h) and each keeps its stream in order, so
+    the log is byte for byte what a single thread writes. The writer owns
+    the output's buffer and file until pipe_stop(); the simulation thread
+    still counts the records itself. With -out none there is no writer.
+*/
+struct pipeline
+{
+    struct trace_reader *trace;
+    struct output *out;
+    struct spsc_ring *events;       // struct input
+    struct spsc_ring *records;      // struct out_record, NULL without a writer
+    pthread_t reader;
+    pthread_t writer;
+    int has_reader;
+    int has_writer;
+    int trace_status;               // trace_next's last return, once events is closed
+};
+
+// starts the threads, trace and out stay the caller's
+struct pipeline *pipe_start(struct trace_reader *trace, struct output *out);
+// same contract as trace_next
+int pipe_next_event(struct pipeline *p, struct input *in);
+// joins the threads once the log is written out, and frees p
+void pipe_stop(struct pipeline *p);
+
+#endif
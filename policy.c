@@ -0,0 +1,219 @@
+#include <stdio.h>
+#include <string.h>
+#include "policy.h"
+#include "scheduler.h"
+
+/*
+    CFS: the leftmost (smallest vruntime) entity runs for its weight's
+    share of the load queued on its CPU times sched_latency, and its share
+    of each group's queue above it, but at least min_granularity. A new task starts at the queue's min_vruntime;
+    a waking one keeps its vruntime.
+*/
+static void cfs_place(struct scheduler *s, struct run_queue *rq, struct task *se, enum place_how how)
+{
+    if (how == PLACE_NEW) se->vmruntime = rq->min_vruntime;
+    else if (how == PLACE_GROUP && se->vmruntime < rq->min_vruntime) se->vmruntime = rq->min_vruntime;
+}
+
+static struct task *cfs_pick(struct run_queue *rq)
+{
+    return rq_peek_min(rq);
+}
+
+static size_t cfs_slice(struct scheduler *s, struct task *t)
+{
+    size_t slice = s->sched_latency;
+    struct task *se = t;
+
+    for (;;)
+    {
+        struct run_queue *rq = se->group ? &se->group->cpus[se->cpu].rq : &s->cpus[se->cpu].run_queue;
+        // t may already be off its queue for the length of the slice
+        unsigned long long load = rq->load + (se->on_rq ? 0 : se->weight);
+
+        slice = slice * se->weight / load;
+        if (!se->group) break;
+        se = &se->group->cpus[se->cpu].se;
+    }
+
+    return slice > s->min_granularity ? slice : s->min_granularity;
+}
+
+static long long cfs_charge(struct scheduler *s, struct task *se, size_t ran)
+{
+    return se->vmruntime + vruntime_delta(se, ran);
+}
+
+/*
+    EEVDF: every entity asks for min_granularity ms at a time, which ends
+    at its virtual deadline, vruntime + request * NICE_0_LOAD / weight. An
+    entity is eligible while its vruntime is at most V, the load-weighted
+    mean vruntime of its queue (rq_avg_vruntime, the running entity
+    included), and the eligible entity with the earliest deadline runs
+    until its request is used up. Leaving a queue keeps the lag
+    V - vruntime, bounded by two requests, and coming back places the
+    entity that far from the new V again.
+*/
+static long long eevdf_vslice(struct scheduler *s, struct task *se)
+{
+    long long vslice = (long long)(((unsigned __int128)s->min_granularity * NICE_0_LOAD * se->inv_weight) >> 32);
+    return vslice > 0 ? vslice : 1;
+}
+
+static void eevdf_place(struct scheduler *s, struct run_queue *rq, struct task *se, enum place_how how)
+{
+    long long vslice = eevdf_vslice(s, se);
+
+    if (how == PLACE_NEW)
+    {
+        // no lag yet, and half a request so a new task gets its turn early
+        se->vmruntime = rq_avg_vruntime(rq);
+        se->deadline = se->vmruntime + vslice / 2;
+        return;
+    }
+
+    // the lag is scaled up because joining the queue moves V towards the newcomer
+    long long lag = se->vlag;
+    if (rq->avg_load) lag = lag * (long long)(rq->avg_load + se->weight) / rq->avg_load;
+
+    se->vmruntime = rq_avg_vruntime(rq) - lag;
+    se->deadline = se->vmruntime + vslice;
+}
+
+static void eevdf_dequeue(struct scheduler *s, struct run_queue *rq, struct task *se)
+{
+    long long limit = 2 * eevdf_vslice(s, se);
+    long long lag = rq_avg_vruntime(rq) - se->vmruntime;
+
+    if (lag > limit) lag = limit;
+    if (lag < -limit) lag = -limit;
+    se->vlag = lag;
+}
+
+static struct task *eevdf_pick(struct run_queue *rq)
+{
+    return rq_empty(rq) ? NULL : rq_pick_deadline(rq);
+}
+
+// what is left of the request, in ms
+static size_t eevdf_slice(struct scheduler *s, struct task *t)
+{
+    long long left = (t->deadline - t->vmruntime) * (long long)t->weight;
+    long long slice = (left + NICE_0_LOAD - 1) / NICE_0_LOAD;
+
+    return slice > 0 ? (size_t)slice : 1;
+}
+
+static long long eevdf_charge(struct scheduler *s, struct task *se, size_t ran)
+{
+    long long vruntime = se->vmruntime + vruntime_delta(se, ran);
+
+    if (vruntime >= se->deadline) se->deadline = vruntime + eevdf_vslice(s, se);
+    return vruntime;
+}
+
+/*
+    FIFO and RR: a single real-time priority level. The key is the queue
+    position, taken from s->queue_seq when a task starts or wakes, so the
+    head runs until it sleeps or is done (FIFO), or until RR_TIMESLICE ms
+    of running have used up its quantum and it goes to the back (RR).
+    Being cut short by an event keeps a task's place.
+*/
+static void fifo_place(struct scheduler *s, struct run_queue *rq, struct task *se, enum place_how how)
+{
+    se->vmruntime = ++s->queue_seq;
+}
+
+static size_t fifo_slice(struct scheduler *s, struct task *t)
+{
+    return t->remaining_time > 0 ? (size_t)t->remaining_time : 1;
+}
+
+static long long fifo_charge(struct scheduler *s, struct task *se, size_t ran)
+{
+    return se->vmruntime;
+}
+
+static void rr_place(struct scheduler *s, struct run_queue *rq, struct task *se, enum place_how how)
+{
+    if (how == PLACE_NEW) se->time_slice = RR_TIMESLICE;
+    se->vmruntime = ++s->queue_seq;
+}
+
+static size_t rr_slice(struct scheduler *s, struct task *t)
+{
+    return t->time_slice > 0 ? (size_t)t->time_slice : 1;
+}
+
+static long long rr_charge(struct scheduler *s, struct task *se, size_t ran)
+{
+    se->time_slice -= (long long)ran;
+    if (se->time_slice > 0) return se->vmruntime;
+
+    se->time_slice = RR_TIMESLICE;
+    return ++s->queue_seq;
+}
+
+const struct sched_policy cfs_policy = {
+    .name      = "cfs",
+    .fair      = 1,
+    .coalesce  = 1,
+    .place     = cfs_place,
+    .pick      = cfs_pick,
+    .slice     = cfs_slice,
+    .charge    = cfs_charge,
+};
+
+const struct sched_policy eevdf_policy = {
+    .name      = "eevdf",
+    .fair      = 1,
+    .deadlines = 1,
+    .place     = eevdf_place,
+    .dequeue   = eevdf_dequeue,
+    .pick      = eevdf_pick,
+    .slice     = eevdf_slice,
+    .charge    = eevdf_charge,
+};
+
+const struct sched_policy fifo_policy = {
+    .name      = "fifo",
+    .place     = fifo_place,
+    .pick      = cfs_pick,
+    .slice     = fifo_slice,
+    .charge    = fifo_charge,
+};
+
+const struct sched_policy rr_policy = {
+    .name      = "rr",
+    .place     = rr_place,
+    .pick      = cfs_pick,
+    .slice     = rr_slice,
+    .charge    = rr_charge,
+};
+
+static const struct sched_policy *policies[] = {
+    &cfs_policy,
+    &eevdf_policy,
+    &fifo_policy,
+    &rr_policy,
+};
+
+#define NR_POLICIES     (sizeof(policies) / sizeof(policies[0]))
+
+const struct sched_policy *policy_by_name(const char *name)
+{
+    for (size_t i = 0; i < NR_POLICIES; i++)
+    {
+        if (strcmp(policies[i]->name, name) == 0) return policies[i];
+    }
+
+    return NULL;
+}
+
+void policy_print_names(FILE *out)
+{
+    for (size_t i = 0; i < NR_POLICIES; i++)
+    {
+        fprintf(out, "%s%s", i ? " | " : "", policies[i]->name);
+    }
+}
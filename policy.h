@@ -0,0 +1,74 @@
+#ifndef _POLICY_H
+#define _POLICY_H
+#include <stddef.h>
+#include "task.h"
+#include "runqueue.h"
+
+struct scheduler;
+
+#define NICE_0_LOAD     1024
+#define RR_TIMESLICE    100     // ms, the kernel's default SCHED_RR quantum
+
+/*
+    Charge delta ms of runtime as delta * NICE_0_LOAD / weight of vruntime,
+    with a multiply by the inverse weight and a shift instead of a divide.
+    The bits below 1 ms carry over in vruntime_frac so nothing is lost to
+    rounding, and a nice 0 task moves by exactly delta.
+*/
+static inline long long vruntime_delta(struct task *t, size_t delta)
+{
+    unsigned __int128 fixed = (unsigned __int128)delta * ((unsigned long long)NICE_0_LOAD * t->inv_weight)
+        + t->vruntime_frac;
+
+    t->vruntime_frac = (unsigned int)fixed;
+    return (long long)(fixed >> 32);
+}
+
+// why an entity is being placed on a queue
+enum place_how
+{
+    PLACE_NEW,      // a task that just started
+    PLACE_WAKE,     // a task back from a sleep
+    PLACE_GROUP,    // a group entity whose group turned busy on that CPU
+};
+
+/*
+    Scheduling policy (-policy). The core owns the queues, CPUs, groups and
+    the event loop; a policy decides what a queue's key means and which
+    entity runs for how long:
+
+        place   sets the key of an entity about to be inserted into rq
+        dequeue (optional) sees an entity leave rq for a sleep, an exit or
+                because its group went idle
+        pick    the entity of rq to run next, NULL if rq is empty
+        slice   ms the task just picked may run before the next pick
+        charge  bills ran ms to an entity that ran (a task, or a group
+                entity above one) and returns its new key
+
+    Keys are the tasks' vmruntime field, so every rq backend serves every
+    policy. In the fair policies it is a virtual runtime; FIFO and RR use
+    it as a queue position, so there groups are ignored and migration
+    keeps the key as it is.
+*/
+struct sched_policy
+{
+    const char *name;
+    int fair;           // keys are vruntimes: task groups and lag-keeping migration apply
+    int coalesce;       // -coalesce applies (it reasons about CFS's leftmost picks)
+    int deadlines;      // queues track avg_vruntime and need rq_ops->pick_deadline
+    void (*place)(struct scheduler *s, struct run_queue *rq, struct task *se, enum place_how how);
+    void (*dequeue)(struct scheduler *s, struct run_queue *rq, struct task *se);
+    struct task *(*pick)(struct run_queue *rq);
+    size_t (*slice)(struct scheduler *s, struct task *t);
+    long long (*charge)(struct scheduler *s, struct task *se, size_t ran);
+};
+
+extern const struct sched_policy cfs_policy;
+extern const struct sched_policy eevdf_policy;
+extern const struct sched_policy fifo_policy;
+extern const struct sched_policy rr_policy;
+
+const struct sched_policy *policy_by_name(const char *name);
+void policy_print_names(FILE *out);
+
+#endif
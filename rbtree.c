@@ -0,0 +1,350 @@
+#include <stddef.h>
+#include <stdlib.h>
+#include "rbtree.h"
+#include "runqueue.h"
+
+static inline int is_black(struct task *node)
+{
+    return !node || node->color == RB_BLACK;
+}
+
+static inline int is_red(struct task *node)
+{
+    return !is_black(node);
+}
+
+// hook v into u's place under u's parent
+static void transplant(struct rb_root_cached *rq, struct task *u, struct task *v)
+{
+    if (!u->parent) rq->root = v;
+    else if (u == u->parent->left) u->parent->left = v;
+    else u->parent->right = v;
+
+    if (v) v->parent = u->parent;
+}
+
+/* Left rotate around x
+ *
+ *    x                    y
+ *   / \                  / \
+ *  T1  y     --->       x  T3
+ *     / \              / \
+ *    T2  T3           T1 T2
+ */
+static void rotate_left(struct rb_root_cached *rq, struct task *x)
+{
+    struct task *y = x->right;
+
+    x->right = y->left;
+    if (y->left) y->left->parent = x;
+
+    transplant(rq, x, y);
+    y->left   = x;
+    x->parent = y;
+
+    rq->rotations++;
+    tp_fire(TP_ROTATION, x->pid, 0, 0);
+}
+
+/* Right rotate around x
+ *
+ *       x                 y
+ *      / \               / \
+ *     y   T3   --->     T1  x
+ *    / \                   / \
+ *   T1  T2                T2  T3
+ */
+static void rotate_right(struct rb_root_cached *rq, struct task *x)
+{
+    struct task *y = x->left;
+
+    x->left = y->right;
+    if (y->right) y->right->parent = x;
+
+    transplant(rq, x, y);
+    y->right  = x;
+    x->parent = y;
+
+    rq->rotations++;
+    tp_fire(TP_ROTATION, x->pid, 1, 0);
+}
+
+static struct task *rb_min(struct task *node)
+{
+    while (node && node->left) node = node->left;
+    return node;
+}
+
+struct task *rb_next(struct task *node)
+{
+    if (node->right) return rb_min(node->right);
+
+    while (node->parent && node == node->parent->right) node = node->parent;
+    return node->parent;
+}
+
+static void insert_fixup(struct rb_root_cached *rq, struct task *node)
+{
+    while (is_red(node->parent))
+    {
+        struct task *parent = node->parent;
+        struct task *gparent = parent->parent;
+
+        if (parent == gparent->left)
+        {
+            struct task *uncle = gparent->right;
+            if (is_red(uncle))
+            {
+                // recolour and move the violation two levels up
+                parent->color = uncle->color = RB_BLACK;
+                gparent->color = RB_RED;
+                node = gparent;
+                continue;
+            }
+
+            if (node == parent->right)
+            {
+                rotate_left(rq, parent);
+                node = parent;
+                parent = node->parent;
+            }
+
+            parent->color  = RB_BLACK;
+            gparent->color = RB_RED;
+            rotate_right(rq, gparent);
+        }
+        else
+        {
+            struct task *uncle = gparent->left;
+            if (is_red(uncle))
+            {
+                parent->color = uncle->color = RB_BLACK;
+                gparent->color = RB_RED;
+                node = gparent;
+                continue;
+            }
+
+            if (node == parent->left)
+            {
+                rotate_right(rq, parent);
+                node = parent;
+                parent = node->parent;
+            }
+
+            parent->color  = RB_BLACK;
+            gparent->color = RB_RED;
+            rotate_left(rq, gparent);
+        }
+    }
+
+    rq->root->color = RB_BLACK;
+}
+
+void rb_insert_cached(struct rb_root_cached *rq, struct task *node)
+{
+    struct task *parent = NULL;
+    struct task **link = &rq->root;
+    char leftmost = 1;
+
+    while (*link)
+    {
+        parent = *link;
+        if (task_compare(node, parent) < 0)
+        {
+            link = &parent->left;
+        }
+        else
+        {
+            link = &parent->right;
+            leftmost = 0;
+        }
+    }
+
+    node->left = node->right = NULL;
+    node->parent = parent;
+    node->color = RB_RED;
+    *link = node;
+
+    if (leftmost) rq->leftmost = node;
+
+    insert_fixup(rq, node);
+}
+
+// x may be NULL (a black leaf), so its parent is tracked separately
+static void erase_fixup(struct rb_root_cached *rq, struct task *x, struct task *parent)
+{
+    while (x != rq->root && is_black(x))
+    {
+        if (x == parent->left)
+        {
+            struct task *w = parent->right;
+            if (is_red(w))
+            {
+                w->color = RB_BLACK;
+                parent->color = RB_RED;
+                rotate_left(rq, parent);
+                w = parent->right;
+            }
+
+            if (is_black(w->left) && is_black(w->right))
+            {
+                w->color = RB_RED;
+                x = parent;
+                parent = x->parent;
+                continue;
+            }
+
+            if (is_black(w->right))
+            {
+                w->left->color = RB_BLACK;
+                w->color = RB_RED;
+                rotate_right(rq, w);
+                w = parent->right;
+            }
+
+            w->color = parent->color;
+            parent->color = RB_BLACK;
+            if (w->right) w->right->color = RB_BLACK;
+            rotate_left(rq, parent);
+            x = rq->root;
+        }
+        else
+        {
+            struct task *w = parent->left;
+            if (is_red(w))
+            {
+                w->color = RB_BLACK;
+                parent->color = RB_RED;
+                rotate_right(rq, parent);
+                w = parent->left;
+            }
+
+            if (is_black(w->left) && is_black(w->right))
+            {
+                w->color = RB_RED;
+                x = parent;
+                parent = x->parent;
+                continue;
+            }
+
+            if (is_black(w->left))
+            {
+                w->right->color = RB_BLACK;
+                w->color = RB_RED;
+                rotate_left(rq, w);
+                w = parent->left;
+            }
+
+            w->color = parent->color;
+            parent->color = RB_BLACK;
+            if (w->left) w->left->color = RB_BLACK;
+            rotate_right(rq, parent);
+            x = rq->root;
+        }
+    }
+
+    if (x) x->color = RB_BLACK;
+}
+
+void rb_erase_cached(struct rb_root_cached *rq, struct task *node)
+{
+    struct task *x, *parent;
+    struct task *y = node;
+    long long y_color = y->color;
+
+    if (rq->leftmost == node) rq->leftmost = rb_next(node);
+
+    if (!node->left)
+    {
+        x = node->right;
+        parent = node->parent;
+        transplant(rq, node, node->right);
+    }
+    else if (!node->right)
+    {
+        x = node->left;
+        parent = node->parent;
+        transplant(rq, node, node->left);
+    }
+    else
+    {
+        // splice the successor into node's place, payloads never move
+        y = rb_min(node->right);
+        y_color = y->color;
+        x = y->right;
+
+        if (y->parent == node)
+        {
+            parent = y;
+        }
+        else
+        {
+            parent = y->parent;
+            transplant(rq, y, y->right);
+            y->right = node->right;
+            y->right->parent = y;
+        }
+
+        transplant(rq, node, y);
+        y->left = node->left;
+        y->left->parent = y;
+        y->color = node->color;
+    }
+
+    node->left = node->right = node->parent = NULL;
+
+    if (y_color == RB_BLACK) erase_fixup(rq, x, parent);
+}
+
+static int rb_rq_init(struct run_queue *rq)
+{
+    rq->rb.root = rq->rb.leftmost = NULL;
+    rq->rb.rotations = 0;
+    return 0;
+}
+
+static void rb_rq_insert(struct run_queue *rq, struct task *t)
+{
+    rb_insert_cached(&rq->rb, t);
+}
+
+static void rb_rq_remove(struct run_queue *rq, struct task *t)
+{
+    rb_erase_cached(&rq->rb, t);
+}
+
+static struct task *rb_rq_peek_min(struct run_queue *rq)
+{
+    return rb_first_cached(&rq->rb);
+}
+
+static struct task *rb_rq_pop_min(struct run_queue *rq)
+{
+    struct task *t = rb_first_cached(&rq->rb);
+    if (t) rb_erase_cached(&rq->rb, t);
+    return t;
+}
+
+static unsigned long long rb_rq_restructures(struct run_queue *rq)
+{
+    return rq->rb.rotations;
+}
+
+static void rb_rq_visit(struct run_queue *rq, struct rq_visitor *v)
+{
+    v->ptr(v, &rq->rb.root);
+    v->ptr(v, &rq->rb.leftmost);
+    v->word(v, &rq->rb.rotations);
+}
+
+const struct rq_ops rb_rq_ops = {
+    .name         = "rbtree",
+    .init         = rb_rq_init,
+    .destroy      = NULL,
+    .insert       = rb_rq_insert,
+    .remove       = rb_rq_remove,
+    .peek_min     = rb_rq_peek_min,
+    .pop_min      = rb_rq_pop_min,
+    .restructures = rb_rq_restructures,
+    .visit        = rb_rq_visit,
+};
@@ -0,0 +1,29 @@
+#ifndef _RBTREE_H
+#define _RBTREE_H
+#include "task.h"
+
+#define RB_RED      0
+#define RB_BLACK    1
+
+/*
+    Red-black run queue with parent links and a cached leftmost node,
+    laid out like the kernel's rb_root_cached. The colour lives in
+    task->color.
+*/
+struct rb_root_cached
+{
+    struct task *root;
+    struct task *leftmost;
+    unsigned long long rotations;
+};
+
+void rb_insert_cached(struct rb_root_cached *rq, struct task *node);
+void rb_erase_cached(struct rb_root_cached *rq, struct task *node);
+struct task *rb_next(struct task *node);
+
+static inline struct task *rb_first_cached(struct rb_root_cached *rq)
+{
+    return rq->leftmost;
+}
+
+#endif
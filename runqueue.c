@@ -0,0 +1,60 @@
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include "runqueue.h"
+
+static const struct rq_ops *rq_backends[] = {
+    &avl_rq_ops,
+    &cavl_rq_ops,
+    &rb_rq_ops,
+    &pheap_rq_ops,
+    &bucketq_rq_ops,
+};
+
+#define NR_RQ_BACKENDS    (sizeof(rq_backends) / sizeof(rq_backends[0]))
+
+const struct rq_ops *rq_ops_by_name(const char *name)
+{
+    for (size_t i = 0; i < NR_RQ_BACKENDS; i++)
+    {
+        if (strcmp(rq_backends[i]->name, name) == 0) return rq_backends[i];
+    }
+
+    return NULL;
+}
+
+void rq_print_backends(FILE *out)
+{
+    for (size_t i = 0; i < NR_RQ_BACKENDS; i++)
+    {
+        fprintf(out, "%s%s", i ? " | " : "", rq_backends[i]->name);
+    }
+}
+
+int rq_pool_init(struct rq_pool *pool, const struct rq_ops *ops)
+{
+    memset(pool, 0, sizeof(*pool));
+    pool->ops = ops;
+
+    return ops->pool_init ? ops->pool_init(pool) : 0;
+}
+
+void rq_pool_destroy(struct rq_pool *pool)
+{
+    if (pool->ops && pool->ops->pool_destroy) pool->ops->pool_destroy(pool);
+}
+
+int rq_init(struct run_queue *rq, const struct rq_ops *ops, struct rq_pool *pool)
+{
+    memset(rq, 0, sizeof(*rq));
+    rq->ops = ops;
+    rq->pool = pool;
+
+    return ops->init(rq);
+}
+
+void rq_destroy(struct run_queue *rq)
+{
+    if (rq->ops && rq->ops->destroy) rq->ops->destroy(rq);
+}
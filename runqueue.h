@@ -0,0 +1,277 @@
+#ifndef _RUNQUEUE_H
+#define _RUNQUEUE_H
+#include <stdio.h>
+#include "task.h"
+#include "tracepoint.h"
+#include "avl.h"
+#include "cavl.h"
+#include "rbtree.h"
+#include "pheap.h"
+#include "bucketq.h"
+
+struct run_queue;
+
+/*
+    Nodes a backend keeps outside the tasks, shared by every queue of one
+    simulation (cavl). An entity takes its node when it is created
+    (rq_attach) and keeps it until it is freed (rq_detach), so inserts
+    never allocate and there is one node per entity, whatever the number
+    of CPUs and groups.
+*/
+struct rq_pool
+{
+    const struct rq_ops *ops;
+    struct cavl_pool cavl;
+};
+
+/*
+    Checkpoints (checkpoint.c) walk the state a backend keeps outside the
+    queued tasks' own links with visit(). The same walk saves and
+    restores: ptr and word either read each slot out or fill it in.
+*/
+struct rq_visitor
+{
+    void (*ptr)(struct rq_visitor *v, struct task **slot);
+    void (*word)(struct rq_visitor *v, unsigned long long *slot);
+    int err;                    // set by a backend with no room for what is restored
+};
+
+/*
+    Run-queue backend. Every backend orders tasks by (vmruntime, pid) and
+    must answer peek_min in O(1). restructures() reports the backend's own
+    cost counter: rotations for the trees, melds for the pairing heap,
+    buckets scanned for the bucket queue.
+
+    update (re-key a queued task) and next (in-order successor) are
+    optional and come as a pair. A backend that has them can keep the
+    running task queued and charge its slices in place. rq_update falls
+    back to remove + insert without them.
+
+    pick_deadline (optional) is the EEVDF pick: the queued task with the
+    earliest deadline among those whose vmruntime is at most vruntime.
+    Only a backend that can answer it in O(log n) offers it.
+
+    insert_batch (optional) queues n tasks linked through ->right at once,
+    rq->nr_running already counts them. rq_insert_batch falls back to one
+    insert per task without it.
+
+    pool_init, pool_destroy, attach and detach (optional, all four) run
+    the backend's rq_pool. attach is -1 when there is no memory for the
+    entity's node. A backend that has them keeps the links of its queued
+    tasks itself and leaves their left / right / parent alone.
+*/
+struct rq_ops
+{
+    const char *name;
+    int (*init)(struct run_queue *rq);
+    void (*destroy)(struct run_queue *rq);
+    void (*insert)(struct run_queue *rq, struct task *t);
+    void (*remove)(struct run_queue *rq, struct task *t);
+    void (*insert_batch)(struct run_queue *rq, struct task *batch, long long n);
+    int (*pool_init)(struct rq_pool *pool);
+    void (*pool_destroy)(struct rq_pool *pool);
+    int (*attach)(struct rq_pool *pool, struct task *t);
+    void (*detach)(struct rq_pool *pool, struct task *t);
+    struct task *(*peek_min)(struct run_queue *rq);
+    struct task *(*pop_min)(struct run_queue *rq);
+    void (*update)(struct run_queue *rq, struct task *t, long long vruntime);
+    struct task *(*next)(struct run_queue *rq, struct task *t);
+    struct task *(*pick_deadline)(struct run_queue *rq, long long vruntime);
+    unsigned long long (*restructures)(struct run_queue *rq);
+    void (*visit)(struct run_queue *rq, struct rq_visitor *v);
+};
+
+struct run_queue
+{
+    const struct rq_ops *ops;
+    struct rq_pool *pool;       // shared with the simulation's other queues
+    long long nr_running;
+    long long min_vruntime;     // vruntime of the leftmost task, 0 when empty
+    unsigned long long load;    // sum of the queued entities' weights
+    int track_avg;              // keep avg_vruntime / avg_load (EEVDF)
+    long long avg_vruntime;     // sum of (vruntime - min_vruntime) * weight
+    long long avg_load;         // sum of weight, with a task running off the queue
+    union
+    {
+        struct avl_root_cached avl;
+        struct cavl cavl;
+        struct rb_root_cached rb;
+        struct pheap pheap;
+        struct bucketq bucketq;
+    };
+};
+
+extern const struct rq_ops avl_rq_ops;
+extern const struct rq_ops cavl_rq_ops;
+extern const struct rq_ops rb_rq_ops;
+extern const struct rq_ops pheap_rq_ops;
+extern const struct rq_ops bucketq_rq_ops;
+
+const struct rq_ops *rq_ops_by_name(const char *name);
+void rq_print_backends(FILE *out);
+int rq_pool_init(struct rq_pool *pool, const struct rq_ops *ops);
+void rq_pool_destroy(struct rq_pool *pool);
+int rq_init(struct run_queue *rq, const struct rq_ops *ops, struct rq_pool *pool);
+void rq_destroy(struct run_queue *rq);
+
+static inline int rq_attach(struct rq_pool *pool, struct task *t)
+{
+    return pool->ops->attach ? pool->ops->attach(pool, t) : 0;
+}
+
+static inline void rq_detach(struct rq_pool *pool, struct task *t)
+{
+    if (pool->ops->detach) pool->ops->detach(pool, t);
+}
+
+/*
+    avg_vruntime is kept relative to min_vruntime so it stays small, and
+    moved along whenever min_vruntime does, like the kernel's cfs_rq.
+*/
+static inline void rq_update_min_vruntime(struct run_queue *rq)
+{
+    struct task *t = rq->ops->peek_min(rq);
+    long long min_vruntime = t ? t->vmruntime : 0;
+
+    if (rq->track_avg) rq->avg_vruntime -= rq->avg_load * (min_vruntime - rq->min_vruntime);
+    rq->min_vruntime = min_vruntime;
+}
+
+static inline void rq_avg_add(struct run_queue *rq, struct task *t)
+{
+    if (!rq->track_avg) return;
+    rq->avg_vruntime += (t->vmruntime - rq->min_vruntime) * (long long)t->weight;
+    rq->avg_load += t->weight;
+}
+
+static inline void rq_avg_sub(struct run_queue *rq, struct task *t)
+{
+    if (!rq->track_avg) return;
+    rq->avg_vruntime -= (t->vmruntime - rq->min_vruntime) * (long long)t->weight;
+    rq->avg_load -= t->weight;
+}
+
+// EEVDF's V: the load-weighted mean vruntime of the queue and its curr, rounded down
+static inline long long rq_avg_vruntime(struct run_queue *rq)
+{
+    long long avg = rq->avg_vruntime;
+
+    if (!rq->avg_load) return rq->min_vruntime;
+    if (avg < 0) avg -= rq->avg_load - 1;
+    return rq->min_vruntime + avg / rq->avg_load;
+}
+
+static inline void rq_insert(struct run_queue *rq, struct task *t)
+{
+    rq->ops->insert(rq, t);
+    rq_avg_add(rq, t);
+    t->on_rq = 1;
+    rq->nr_running++;
+    rq->load += t->weight;
+    rq_update_min_vruntime(rq);
+    tp_fire(TP_ENQUEUE, t->pid, t->vmruntime, rq->nr_running);
+}
+
+/*
+    Same as rq_insert on each of the n tasks linked through ->right. The
+    averages are summed against the min_vruntime from before the batch
+    and moved along once at the end.
+*/
+static inline void rq_insert_batch(struct run_queue *rq, struct task *batch, long long n)
+{
+    for (struct task *t = batch; t; t = t->right)
+    {
+        rq_avg_add(rq, t);
+        t->on_rq = 1;
+        rq->nr_running++;
+        rq->load += t->weight;
+        tp_fire(TP_ENQUEUE, t->pid, t->vmruntime, rq->nr_running);
+    }
+
+    if (rq->ops->insert_batch)
+    {
+        rq->ops->insert_batch(rq, batch, n);
+    }
+    else
+    {
+        while (batch)
+        {
+            struct task *next = batch->right;
+            rq->ops->insert(rq, batch);
+            batch = next;
+        }
+    }
+    rq_update_min_vruntime(rq);
+}
+
+static inline void rq_remove(struct run_queue *rq, struct task *t)
+{
+    rq->ops->remove(rq, t);
+    rq_avg_sub(rq, t);
+    t->on_rq = 0;
+    rq->nr_running--;
+    rq->load -= t->weight;
+    rq_update_min_vruntime(rq);
+    tp_fire(TP_DEQUEUE, t->pid, t->vmruntime, rq->nr_running);
+}
+
+static inline struct task *rq_peek_min(struct run_queue *rq)
+{
+    return rq->ops->peek_min(rq);
+}
+
+static inline struct task *rq_pop_min(struct run_queue *rq)
+{
+    struct task *t = rq->ops->pop_min(rq);
+    if (t)
+    {
+        rq_avg_sub(rq, t);
+        t->on_rq = 0;
+        rq->nr_running--;
+        rq->load -= t->weight;
+        rq_update_min_vruntime(rq);
+        tp_fire(TP_DEQUEUE, t->pid, t->vmruntime, rq->nr_running);
+    }
+    return t;
+}
+
+static inline int rq_can_update(struct run_queue *rq)
+{
+    return rq->ops->update != NULL;
+}
+
+// move a queued task to a new vruntime, in place when the backend can
+static inline void rq_update(struct run_queue *rq, struct task *t, long long vruntime)
+{
+    if (rq->track_avg) rq->avg_vruntime += (vruntime - t->vmruntime) * (long long)t->weight;
+
+    if (rq->ops->update)
+    {
+        rq->ops->update(rq, t, vruntime);
+    }
+    else
+    {
+        rq->ops->remove(rq, t);
+        t->vmruntime = vruntime;
+        rq->ops->insert(rq, t);
+    }
+    rq_update_min_vruntime(rq);
+}
+
+// eligible (vruntime <= V) task with the earliest deadline, needs track_avg
+static inline struct task *rq_pick_deadline(struct run_queue *rq)
+{
+    return rq->ops->pick_deadline(rq, rq_avg_vruntime(rq));
+}
+
+static inline struct task *rq_next(struct run_queue *rq, struct task *t)
+{
+    return rq->ops->next(rq, t);
+}
+
+static inline int rq_empty(struct run_queue *rq)
+{
+    return rq->nr_running == 0;
+}
+
+#endif
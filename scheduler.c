@@ -0,0 +1,1283 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <assert.h>
+#include "scheduler.h"
+#include "checkpoint.h"
+
+/*
+    Nice level to load weight and 2^32 / weight, as in the kernel's
+    sched_prio_to_weight / sched_prio_to_wmult. Each step is ~10% of CPU.
+*/
+static const unsigned int prio_to_weight[40] = {
+ /* -20 */     88761,     71755,     56483,     46273,     36291,
+ /* -15 */     29154,     23254,     18705,     14949,     11916,
+ /* -10 */      9548,      7620,      6100,      4904,      3906,
+ /*  -5 */      3121,      2501,      1991,      1586,      1277,
+ /*   0 */      1024,       820,       655,       526,       423,
+ /*   5 */       335,       272,       215,       172,       137,
+ /*  10 */       110,        87,        70,        56,        45,
+ /*  15 */        36,        29,        23,        18,        15,
+};
+
+static const unsigned int prio_to_wmult[40] = {
+ /* -20 */     48388,     59856,     76040,     92818,    118348,
+ /* -15 */    147320,    184698,    229616,    287308,    360437,
+ /* -10 */    449829,    563644,    704093,    875809,   1099582,
+ /*  -5 */   1376151,   1717300,   2157191,   2708050,   3363326,
+ /*   0 */   4194304,   5237765,   6557202,   8165337,  10153587,
+ /*   5 */  12820798,  15790321,  19976592,  24970740,  31350126,
+ /*  10 */  39045157,  49367440,  61356676,  76695844,  95443717,
+ /*  15 */ 119304647, 148102320, 186737708, 238609294, 286331153,
+};
+
+static void set_task_nice(struct task *t, int nice)
+{
+    if (nice < -20) nice = -20;
+    if (nice > 19) nice = 19;
+
+    t->weight = prio_to_weight[nice + 20];
+    t->inv_weight = prio_to_wmult[nice + 20];
+    t->vruntime_frac = 0;
+}
+
+static const char *hist_metric_names[HIST_NR_METRICS] = {
+    [HIST_WAIT]    = "wait",
+    [HIST_LATENCY] = "latency",
+    [HIST_SLICE]   = "slice",
+};
+
+static inline struct hist *task_hist(struct task *t, int metric)
+{
+    return (struct hist *)((char *)t->hist + metric * hist_size(HIST_TASK_BITS));
+}
+
+static inline void hist_sample(struct scheduler *s, struct task *t, int metric, long long value)
+{
+    if (!s->hist_format) return;
+
+    hist_record(s->hist[metric], value);
+    if (t->hist) hist_record(task_hist(t, metric), value);
+}
+
+static void hist_task_start(struct scheduler *s, struct task *t)
+{
+    t->hist = s->hist_format && s->hist_tasks ? slab_alloc(&s->hist_slab) : NULL;
+    if (!t->hist) return;
+
+    for (int m = 0; m < HIST_NR_METRICS; m++) hist_init(task_hist(t, m), HIST_TASK_BITS);
+}
+
+static void hist_write_metric(struct scheduler *s, const char *scope, long long pid, int metric, struct hist *h)
+{
+    double mean = h->count ? (double)h->sum / h->count : 0.0;
+    unsigned long long p50 = hist_percentile(h, 50.0);
+    unsigned long long p99 = hist_percentile(h, 99.0);
+    unsigned long long p999 = hist_percentile(h, 99.9);
+
+    if (s->hist_format == HIST_CSV)
+    {
+        fprintf(s->hist_out, "%s,", scope);
+        if (pid >= 0) fprintf(s->hist_out, "%lld", pid);
+        fprintf(s->hist_out, ",%s,%llu,%.2f,%llu,%llu,%llu,%llu\n", hist_metric_names[metric],
+            h->count, mean, p50, p99, p999, h->max);
+        return;
+    }
+
+    fprintf(s->hist_out, "%s\"%s\": {\"count\": %llu, \"mean\": %.2f, \"p50\": %llu, \"p99\": %llu, \"p999\": %llu, \"max\": %llu}",
+        metric ? ", " : "", hist_metric_names[metric], h->count, mean, p50, p99, p999, h->max);
+}
+
+// one row (CSV: one line per metric) for a task that is going away
+static void hist_task_exit(struct scheduler *s, struct task *t)
+{
+    if (!t->hist) return;
+
+    if (s->hist_format == HIST_JSON) fprintf(s->hist_out, "%s\n  {\"pid\": %lld, ", s->hist_rows ? "," : "", t->pid);
+    for (int m = 0; m < HIST_NR_METRICS; m++) hist_write_metric(s, "task", t->pid, m, task_hist(t, m));
+    if (s->hist_format == HIST_JSON) fprintf(s->hist_out, "}");
+
+    s->hist_rows++;
+    slab_free(&s->hist_slab, t->hist);
+    t->hist = NULL;
+}
+
+static void hist_begin(struct scheduler *s)
+{
+    if (s->hist_format == HIST_CSV) fprintf(s->hist_out, "scope,pid,metric,count,mean,p50,p99,p999,max\n");
+    else fprintf(s->hist_out, "{\"tasks\": [");
+}
+
+// rows for tasks that never exited, then the whole-run totals
+static void hist_end(struct scheduler *s)
+{
+    struct hash *pids = s->pid_map;
+
+    for (long long i = 0; i < pids->table_size; i++)
+    {
+        if (pids->hashmap[i].val) hist_task_exit(s, pids->hashmap[i].val);
+    }
+
+    if (s->hist_format == HIST_JSON) fprintf(s->hist_out, "\n], \"all\": {");
+    for (int m = 0; m < HIST_NR_METRICS; m++) hist_write_metric(s, "all", -1, m, s->hist[m]);
+    if (s->hist_format == HIST_JSON) fprintf(s->hist_out, "}}\n");
+
+    fflush(s->hist_out);
+}
+
+static inline struct group_cpu *group_cpu_of(struct task *se)
+{
+    return (struct group_cpu *)((char *)se - offsetof(struct group_cpu, se));
+}
+
+// queue se goes on while it is on cpu
+static inline struct run_queue *entity_rq(struct scheduler *s, struct task *se, int cpu)
+{
+    return se->group ? &se->group->cpus[cpu].rq : &s->cpus[cpu].run_queue;
+}
+
+struct task_group *sched_find_group(struct scheduler *s, long long id)
+{
+    struct task *se = id > 0 ? map_lookup(&s->group_map, id) : NULL;
+    return se ? group_cpu_of(se)->tg : NULL;
+}
+
+/*
+    Queues t on cpu, and the entities of the groups that turn busy there
+    with it. The policy places a group entity coming back from idle (CFS:
+    no further left than its queue's min_vruntime, it gets no credit for
+    the idle time).
+*/
+static void enqueue_task(struct scheduler *s, struct task *t, struct cpu *cpu)
+{
+    rq_insert(entity_rq(s, t, cpu->id), t);
+    cpu->h_nr_running++;
+
+    for (struct task_group *g = t->group; g; g = g->parent)
+    {
+        struct group_cpu *gc = &g->cpus[cpu->id];
+        if (gc->nr_busy++) break;
+
+        struct run_queue *rq = entity_rq(s, &gc->se, cpu->id);
+        s->policy->place(s, rq, &gc->se, PLACE_GROUP);
+        rq_insert(rq, &gc->se);
+    }
+}
+
+// takes t off cpu, unless it is running and already unlinked, and the groups that go idle with it
+static void dequeue_task(struct scheduler *s, struct task *t, struct cpu *cpu)
+{
+    if (t->on_rq)
+    {
+        struct run_queue *rq = entity_rq(s, t, cpu->id);
+        if (s->policy->dequeue) s->policy->dequeue(s, rq, t);
+        rq_remove(rq, t);
+        cpu->h_nr_running--;
+    }
+
+    for (struct task_group *g = t->group; g; g = g->parent)
+    {
+        struct group_cpu *gc = &g->cpus[cpu->id];
+        if (--gc->nr_busy) break;
+
+        struct run_queue *rq = entity_rq(s, &gc->se, cpu->id);
+        if (s->policy->dequeue) s->policy->dequeue(s, rq, &gc->se);
+        rq_remove(rq, &gc->se);
+    }
+}
+
+// a slice of a task in a group also moves every group entity above it
+static void charge_groups(struct scheduler *s, struct task *t, int cpu, size_t slice)
+{
+    for (struct task_group *g = t->group; g; g = g->parent)
+    {
+        struct task *se = &g->cpus[cpu].se;
+        long long vruntime = s->policy->charge(s, se, slice);
+
+        if (se->on_rq) rq_update(entity_rq(s, se, cpu), se, vruntime);
+        else se->vmruntime = vruntime;
+    }
+}
+
+/*
+    Leftmost entity of rq, then of its queue while that is a group, down
+    to a task. *leaf is the queue the task is on. NULL if the walk ends in
+    a group whose only busy task is running (on another CPU's clock).
+*/
+static struct task *pick_leftmost(struct run_queue *rq, struct run_queue **leaf)
+{
+    struct task *se = rq_peek_min(rq);
+
+    while (se && se->is_group)
+    {
+        rq = &group_cpu_of(se)->rq;
+        se = rq_peek_min(rq);
+    }
+
+    *leaf = rq;
+    return se;
+}
+
+// the same walk down with the policy's pick at every level
+static struct task *pick_next_entity(struct scheduler *s, struct run_queue *rq, struct run_queue **leaf)
+{
+    struct task *se = s->policy->pick(rq);
+
+    while (se && se->is_group)
+    {
+        rq = &group_cpu_of(se)->rq;
+        se = s->policy->pick(rq);
+    }
+
+    *leaf = rq;
+    return se;
+}
+
+static inline long long cpu_load(struct cpu *cpu)
+{
+    return cpu->h_nr_running + (cpu->curr && !cpu->curr->on_rq);
+}
+
+static inline int cpu_idle(struct cpu *cpu)
+{
+    return cpu_load(cpu) == 0;
+}
+
+// make an idle CPU look for work in the current step
+static void kick_cpu(struct scheduler *s, struct cpu *cpu)
+{
+    if (!cpu->curr) cpu->clock = s->sim_time;
+}
+
+/*
+    Wakeup/fork CPU selection: stay on the previous CPU if it is idle, else
+    take any idle CPU, else the least loaded one (previous CPU wins ties).
+*/
+static struct cpu *select_task_cpu(struct scheduler *s, int prev)
+{
+    struct cpu *best = &s->cpus[prev];
+    if (cpu_idle(best)) return best;
+
+    for (int i = 0; i < s->nr_cpus; i++)
+    {
+        struct cpu *cpu = &s->cpus[i];
+        if (cpu_load(cpu) < cpu_load(best)) best = cpu;
+    }
+
+    return best;
+}
+
+// vruntime is relative to each queue's min_vruntime, carry the lag over
+static void migrate_task(struct scheduler *s, struct task *t, struct cpu *src, struct cpu *dst)
+{
+    if (s->policy->fair)
+    {
+        long long shift = entity_rq(s, t, dst->id)->min_vruntime - entity_rq(s, t, src->id)->min_vruntime;
+        t->vmruntime += shift;
+        t->deadline += shift;
+    }
+    t->cpu = dst->id;
+
+    src->migrations_out++;
+    dst->migrations_in++;
+    s->nr_migrations++;
+    tp_fire(TP_MIGRATE, t->pid, src->id, dst->id);
+}
+
+static void node_delete(struct scheduler *s, long long pid, char is_exit) {
+    struct task *victim = map_lookup(&s->pid_map, pid);
+    if (!victim || !victim->on_rq) {
+        #ifdef DEBUG
+        fprintf(stderr, "node_delete: pid=%lld not found in AVL\n", pid);
+        #endif
+        return;
+    }
+
+    dequeue_task(s, victim, &s->cpus[victim->cpu]);
+
+    if (is_exit) {
+        hist_task_exit(s, victim);
+        map_delete(&s->pid_map, pid);
+        rq_detach(&s->rq_pool, victim);
+        slab_free(&s->task_slab, victim);
+    } else {
+        // the same task object parks in the wake map, pid_map stays valid
+        map_insert(&s->wake_queue_task_map, pid, victim);
+    }
+}
+
+
+/*
+    Queues the tasks each CPU started in this timestamp as one batch, so a
+    burst of STARTs is one O(n) bulk load instead of n inserts. Runs
+    before any event that could look at a queue, and at the end of the
+    timestamp.
+*/
+static void flush_new_tasks(struct scheduler *s)
+{
+    for (int i = 0; i < s->nr_cpus; i++)
+    {
+        struct cpu *cpu = &s->cpus[i];
+        if (!cpu->nr_new) continue;
+
+        cpu->new_last->right = NULL;
+        rq_insert_batch(&cpu->run_queue, cpu->new_tasks, cpu->nr_new);
+        cpu->new_tasks = cpu->new_last = NULL;
+        cpu->nr_new = 0;
+    }
+}
+
+static void new_task_event(struct scheduler *s, long long pid, long long vmruntime, int nice, long long group)
+{
+    struct cpu *cpu = select_task_cpu(s, 0);
+    struct task_group *tg = s->policy->fair ? sched_find_group(s, group) : NULL;
+    struct task *t = slab_alloc(&s->task_slab);
+    if (!t || rq_attach(&s->rq_pool, t) < 0) {
+        #ifdef DEBUG
+        fprintf(stderr, "START: oom for pid=%lld\n", pid);
+        #endif
+        if (t) slab_free(&s->task_slab, t);
+        return;
+    }
+    t->pid = pid;
+    t->group = tg;
+    t->is_group = 0;
+    t->timer_slot = 0;
+    t->deadline = t->vlag = 0;
+    t->cpu = cpu->id;
+    t->remaining_time = vmruntime;
+    t->left = t->right = t->parent = NULL;
+    t->runnable_since = s->sim_time;
+    t->wake_pending = 1;
+    set_task_nice(t, nice);
+    s->policy->place(s, entity_rq(s, t, cpu->id), t, PLACE_NEW);
+    hist_task_start(s, t);
+
+    #ifdef DEBUG
+    if (group && !sched_find_group(s, group)) fprintf(stderr, "START: pid=%lld in unknown group %lld\n", pid, group);
+    #endif
+
+    if (t->group)
+    {
+        flush_new_tasks(s);
+        enqueue_task(s, t, cpu);
+    }
+    else
+    {
+        // placing it on the queue it has not joined yet is exact: it goes
+        // where min_vruntime (or V) already is and does not move it
+        if (cpu->nr_new++) cpu->new_last->right = t;
+        else cpu->new_tasks = t;
+        cpu->new_last = t;
+        cpu->h_nr_running++;
+    }
+    map_insert(&s->pid_map, pid, t);
+    s->number_of_tasks++;
+    if (s->number_of_tasks > s->max_tasks) s->max_tasks = s->number_of_tasks;
+    kick_cpu(s, cpu);
+
+    out_start(&s->output, s->sim_time, cpu->id, pid, vmruntime);
+}
+
+/*
+    A new point in time something happens at, found after the CPUs last
+    picked: idle CPUs look again then, and running slices end there at
+    the latest, as if next_decision_time() had known it when they started.
+*/
+static void add_decision_point(struct scheduler *s, size_t time)
+{
+    for (int i = 0; i < s->nr_cpus; i++)
+    {
+        struct cpu *cpu = &s->cpus[i];
+        if (cpu->clock <= time) continue;
+
+        if (cpu->curr)
+        {
+            cpu->slice -= cpu->clock - time;
+            cpu->busy_time -= cpu->clock - time;
+        }
+        cpu->clock = time;
+    }
+}
+
+// a timed sleep (duration > 0) wakes on its own once the timer wheel expires it
+static void sleep_task_event(struct scheduler *s, long long pid, long long duration) 
+{
+    struct task *n = map_lookup(&s->pid_map, pid);
+    if (!n || !n->on_rq) {
+        #ifdef DEBUG
+        fprintf(stderr, "SLEEP: PID %lld not found in runqueue\n", pid);
+        #endif
+        return;
+    }
+
+    tp_fire(TP_SLEEP, pid, n->cpu, n->remaining_time);
+    node_delete(s, pid, 0); // moves to wake map
+
+    if (duration > 0)
+    {
+        tw_arm(&s->timers, n, s->sim_time + duration);
+        add_decision_point(s, s->sim_time + duration);
+    }
+}
+
+static void wake_task(struct scheduler *s, struct task *wake_node)
+{
+    struct cpu *prev = &s->cpus[wake_node->cpu];
+    struct cpu *cpu = select_task_cpu(s, prev->id);
+    if (cpu != prev) migrate_task(s, wake_node, prev, cpu);
+    s->policy->place(s, entity_rq(s, wake_node, cpu->id), wake_node, PLACE_WAKE);
+
+    tp_fire(TP_WAKE, wake_node->pid, cpu->id, wake_node->vmruntime);
+    wake_node->runnable_since = s->sim_time;
+    wake_node->wake_pending = 1;
+    enqueue_task(s, wake_node, cpu);
+    kick_cpu(s, cpu);
+
+    out_wakeup(&s->output, s->sim_time, cpu->id, wake_node->pid, wake_node->vmruntime, wake_node->remaining_time);
+}
+
+// an explicit wakeup also ends a timed sleep early
+static void wakeup_task_event(struct scheduler *s, long long pid) {
+    struct task *wake_node = map_lookup(&s->wake_queue_task_map, pid);
+    if (!wake_node) {
+        #ifdef DEBUG
+        fprintf(stderr, "WAKEUP: PID %lld not found in sleep map\n", pid);
+        #endif
+        return;
+    }
+
+    assert(wake_node->pid == pid);
+    map_delete(&s->wake_queue_task_map, pid);
+    if (tw_armed(wake_node)) tw_cancel(&s->timers, wake_node);
+    wake_task(s, wake_node);
+}
+
+// timed sleeps due by sim_time, one batch off the timer wheel
+static void expire_timers(struct scheduler *s)
+{
+    struct task *t = tw_expire(&s->timers, s->sim_time);
+
+    while (t)
+    {
+        struct task *next = t->right;   // enqueue reuses the link
+        map_delete(&s->wake_queue_task_map, t->pid);
+        wake_task(s, t);
+        t = next;
+    }
+}
+
+static void exit_task_event(struct scheduler *s, long long pid) {
+    struct task *n = map_lookup(&s->pid_map, pid);
+    if (n) tp_fire(TP_EXIT, pid, n->cpu, n->remaining_time);
+
+    if (n && n->on_rq) {
+        node_delete(s, pid, 1);
+        s->number_of_tasks--;
+        out_exit(&s->output, s->sim_time, -1, pid);
+        return;
+    }
+
+    if (n) {
+        map_delete(&s->wake_queue_task_map, n->pid);
+        if (tw_armed(n)) tw_cancel(&s->timers, n);
+        map_delete(&s->pid_map, n->pid);
+        hist_task_exit(s, n);
+        rq_detach(&s->rq_pool, n);
+        slab_free(&s->task_slab, n);
+        s->number_of_tasks--;
+        out_exit(&s->output, s->sim_time, -1, pid);
+        return;
+    }
+
+    #ifdef DEBUG
+    fprintf(stderr, "EXIT: Unknown PID %lld\n", pid);
+    #endif
+}
+
+// undoes sched_new_group on the first nr CPUs of tg
+static void free_group(struct scheduler *s, struct task_group *tg, int nr)
+{
+    for (int i = 0; i < nr; i++)
+    {
+        rq_detach(&s->rq_pool, &tg->cpus[i].se);
+        rq_destroy(&tg->cpus[i].rq);
+    }
+    free(tg);
+}
+
+/*
+    Creates an idle group with an empty queue on every CPU, NULL if id is
+    taken or out of memory. Groups live until sched_destroy, an unknown
+    parent means the root.
+*/
+struct task_group *sched_new_group(struct scheduler *s, long long id, long long shares, long long parent)
+{
+    if (id <= 0 || sched_find_group(s, id)) {
+        #ifdef DEBUG
+        fprintf(stderr, "GROUP: bad or repeated id %lld\n", id);
+        #endif
+        return NULL;
+    }
+
+    struct task_group *tg = calloc(1, sizeof(*tg) + s->nr_cpus * sizeof(struct group_cpu));
+    if (!tg) {
+        #ifdef DEBUG
+        fprintf(stderr, "GROUP: oom for id=%lld\n", id);
+        #endif
+        return NULL;
+    }
+
+    if (shares < GROUP_MIN_SHARES) shares = GROUP_MIN_SHARES;
+    if (shares > GROUP_MAX_SHARES) shares = GROUP_MAX_SHARES;
+    tg->id = id;
+    tg->parent = sched_find_group(s, parent);
+    tg->shares = (unsigned int)shares;
+
+    #ifdef DEBUG
+    if (parent && !tg->parent) fprintf(stderr, "GROUP: id=%lld has unknown parent %lld\n", id, parent);
+    #endif
+
+    for (int i = 0; i < s->nr_cpus; i++)
+    {
+        struct group_cpu *gc = &tg->cpus[i];
+
+        if (rq_init(&gc->rq, s->rq_ops, &s->rq_pool) < 0)
+        {
+            #ifdef DEBUG
+            fprintf(stderr, "GROUP: cant init run queue for id=%lld\n", id);
+            #endif
+            free_group(s, tg, i);
+            return NULL;
+        }
+        if (rq_attach(&s->rq_pool, &gc->se) < 0)
+        {
+            #ifdef DEBUG
+            fprintf(stderr, "GROUP: oom for id=%lld\n", id);
+            #endif
+            rq_destroy(&gc->rq);
+            free_group(s, tg, i);
+            return NULL;
+        }
+
+        gc->rq.track_avg = s->policy->deadlines;
+        gc->tg = tg;
+        gc->se.pid = -id;   // keeps (vruntime, pid) keys unique next to tasks
+        gc->se.cpu = i;
+        gc->se.is_group = 1;
+        gc->se.group = tg->parent;
+        gc->se.weight = tg->shares;
+        gc->se.inv_weight = (unsigned int)((1ULL << 32) / tg->shares);
+    }
+
+    tg->next = s->groups;
+    s->groups = tg;
+    map_insert(&s->group_map, id, &tg->cpus[0].se);
+    return tg;
+}
+
+// the trace's next event, through the reader thread with -pipeline
+static int next_event(struct scheduler *s, struct input *in)
+{
+    return s->pipe ? pipe_next_event(s->pipe, in) : trace_next(s->trace, in);
+}
+
+/*
+    Drains every event that is due at sim_time as one batch, so the CPUs
+    only pick again once the whole timestamp has been applied. Timed
+    sleeps that end now wake before the trace's own events at this time.
+*/
+static void process_events(struct scheduler *s) {
+    expire_timers(s);
+
+    while (!s->event_complete && (size_t)s->last_command.time <= s->sim_time) {
+        struct input *cmd = &s->last_command;
+
+        out_event(&s->output, cmd->time, cmd->action, cmd->pid, cmd->runtime);
+        s->nr_events++;
+
+        if (cmd->action != TRACE_START) flush_new_tasks(s);
+
+        switch (cmd->action) {
+        case TRACE_START:
+            new_task_event(s, cmd->pid, cmd->runtime, cmd->nice, cmd->group);
+            break;
+        case TRACE_SLEEP:
+            sleep_task_event(s, cmd->pid, cmd->runtime);
+            break;
+        case TRACE_WAKEUP:
+            wakeup_task_event(s, cmd->pid);
+            break;
+        case TRACE_EXIT:
+            exit_task_event(s, cmd->pid);
+            break;
+        case TRACE_GROUP:
+            sched_new_group(s, cmd->pid, cmd->runtime, cmd->group);
+            break;
+        default:
+            #ifdef DEBUG
+            fprintf(stderr, "Unknown action at time %lld\n", cmd->time);
+            #endif
+            break;
+        }
+
+        if (next_event(s, cmd) <= 0) s->event_complete = 1;
+    }
+
+    flush_new_tasks(s);
+}
+
+// the slice on cpu has ended: charge it to curr and requeue it
+static void put_prev_task(struct scheduler *s, struct cpu *cpu) {
+    struct task *t = cpu->curr;
+    size_t slice = cpu->slice;
+    cpu->curr = NULL;
+
+    // Update times, a task that stayed queued is re-keyed in place
+    struct run_queue *rq = entity_rq(s, t, cpu->id);
+    if (!t->on_rq) rq_avg_sub(rq, t);
+    t->remaining_time -= slice;
+    if (t->remaining_time <= 0) dequeue_task(s, t, cpu);
+
+    long long vruntime = s->policy->charge(s, t, slice);
+    if (t->on_rq) rq_update(rq, t, vruntime);
+    else t->vmruntime = vruntime;
+    if (t->group) charge_groups(s, t, cpu->id, slice);
+
+    out_slice(&s->output, s->sim_time, cpu->id, t->pid, slice, t->vmruntime, t->remaining_time);
+    hist_sample(s, t, HIST_SLICE, slice);
+
+    // Reinsert if still alive
+    if (t->remaining_time > 0) {
+        t->runnable_since = s->sim_time;
+        if (!t->on_rq) {
+            rq_insert(rq, t);
+            cpu->h_nr_running++;
+        }
+    } else {
+        tp_fire(TP_EXIT, t->pid, cpu->id, t->remaining_time);
+        out_exit(&s->output, s->sim_time, cpu->id, t->pid);
+        hist_task_exit(s, t);
+        map_delete(&s->pid_map, t->pid);
+        rq_detach(&s->rq_pool, t);
+        slab_free(&s->task_slab, t);
+        s->number_of_tasks--;
+    }
+}
+
+static struct cpu *busiest_cpu(struct scheduler *s)
+{
+    struct cpu *busiest = &s->cpus[0];
+
+    for (int i = 1; i < s->nr_cpus; i++)
+    {
+        if (cpu_load(&s->cpus[i]) > cpu_load(busiest)) busiest = &s->cpus[i];
+    }
+
+    return busiest;
+}
+
+// move the next waiting task of src over to dst, 0 if there is none to take
+static int pull_task(struct scheduler *s, struct cpu *src, struct cpu *dst)
+{
+    struct run_queue *rq;
+    struct task *t = pick_leftmost(&src->run_queue, &rq);
+    if (!t) return 0;
+
+    rq_pop_min(rq);
+    src->h_nr_running--;
+    dequeue_task(s, t, src);
+    migrate_task(s, t, src, dst);
+    enqueue_task(s, t, dst);
+    kick_cpu(s, dst);
+    return 1;
+}
+
+// newly idle: steal from the busiest CPU if it has a task waiting behind another
+static void idle_balance(struct scheduler *s, struct cpu *cpu)
+{
+    struct cpu *busiest = busiest_cpu(s);
+
+    if (busiest != cpu && cpu_load(busiest) >= 2 && busiest->h_nr_running)
+    {
+        pull_task(s, busiest, cpu);
+    }
+}
+
+/*
+    Periodic balance, run when every busy CPU sits at a slice boundary:
+    keep moving one task from the busiest to the idlest CPU until their
+    loads are within one of each other.
+*/
+static void load_balance(struct scheduler *s)
+{
+    for (size_t moves = 0; moves < s->number_of_tasks; moves++)
+    {
+        struct cpu *busiest = busiest_cpu(s);
+        struct cpu *idlest = &s->cpus[0];
+
+        for (int i = 1; i < s->nr_cpus; i++)
+        {
+            if (cpu_load(&s->cpus[i]) < cpu_load(idlest)) idlest = &s->cpus[i];
+        }
+
+        if (cpu_load(busiest) - cpu_load(idlest) < 2 || !busiest->h_nr_running) break;
+        if (!pull_task(s, busiest, idlest)) break;
+    }
+}
+
+// next time the trace or a timed sleep brings new work
+static size_t next_arrival_time(struct scheduler *s)
+{
+    size_t next = s->event_complete ? NO_TIME : (size_t)s->last_command.time;
+    long long timer = tw_next_expiry(&s->timers);
+
+    if (timer != TW_NO_EXPIRY && (size_t)timer < next) next = (size_t)timer;
+    return next;
+}
+
+// next time the trace, a timer or the balancer can change a decision
+static size_t next_decision_time(struct scheduler *s)
+{
+    size_t next = next_arrival_time(s);
+
+    if (s->nr_cpus > 1 && s->next_balance < next) next = s->next_balance;
+
+    return next;
+}
+
+/*
+    Number of back-to-back slices of length q the task just picked on cpu
+    would get if it were requeued and picked again at every boundary. That
+    goes on until another waiting task becomes leftmost or the task runs
+    out of runtime. It also stops at the first boundary at or after
+    another CPU's clock, since that CPU may pull from this queue or change
+    number_of_tasks. Event and balance points are clipped by the caller.
+*/
+static long long coalesced_slices(struct scheduler *s, struct cpu *cpu, size_t q)
+{
+    struct task *t = cpu->curr;
+    struct task *next = t->on_rq ? rq_next(&cpu->run_queue, t) : rq_peek_min(&cpu->run_queue);
+    long long n = (t->remaining_time + (long long)q - 1) / (long long)q;
+
+    if (next)
+    {
+        // first j with (vruntime + j slices, pid) past next's key, in the
+        // same fixed point vruntime_delta() charges with
+        long long d = next->vmruntime - t->vmruntime + (t->pid < next->pid);
+        unsigned __int128 step = (unsigned __int128)q * ((unsigned long long)NICE_0_LOAD * t->inv_weight);
+        long long j = 1;
+
+        if (d > 0)
+        {
+            unsigned __int128 need = ((unsigned __int128)d << 32) - t->vruntime_frac;
+            j = (long long)((need + step - 1) / step);
+        }
+        if (j < n) n = j;
+    }
+
+    for (int i = 0; i < s->nr_cpus; i++)
+    {
+        struct cpu *other = &s->cpus[i];
+        if (other == cpu || other->clock == NO_TIME) continue;
+
+        long long j = (long long)((other->clock - s->sim_time + q - 1) / q);
+        if (j < n) n = j;
+    }
+
+    return n < 1 ? 1 : n;
+}
+
+static void pick_next_task(struct scheduler *s, struct cpu *cpu) {
+    if (!cpu->h_nr_running && s->nr_cpus > 1) idle_balance(s, cpu);
+
+    if (!cpu->h_nr_running || s->number_of_tasks == 0) {
+        // idle until the trace or a timer has something new
+        cpu->clock = next_arrival_time(s);
+        return;
+    }
+
+    /*
+        With one CPU nothing can look at the queue while a slice runs, so
+        curr may stay queued and be re-keyed in place when it ends. That
+        skips the pop + insert (and their rotations) whenever it is still
+        leftmost afterwards. Group entities always stay queued.
+    */
+    struct run_queue *rq;
+    cpu->curr = pick_next_entity(s, &cpu->run_queue, &rq);
+    if (s->nr_cpus > 1 || !rq_can_update(rq))
+    {
+        if (cpu->curr == rq_peek_min(rq)) rq_pop_min(rq);
+        else rq_remove(rq, cpu->curr);
+        cpu->h_nr_running--;
+
+        // it still counts towards V while it runs, as it does queued
+        rq_avg_add(rq, cpu->curr);
+    }
+
+    struct task *t = cpu->curr;
+    hist_sample(s, t, HIST_WAIT, s->sim_time - t->runnable_since);
+    if (t->wake_pending)
+    {
+        hist_sample(s, t, HIST_LATENCY, s->sim_time - t->runnable_since);
+        t->wake_pending = 0;
+    }
+
+    size_t slice = s->policy->slice(s, t);
+
+    // the next entity to pass a grouped task may be a level up, so no coalescing there
+    if (s->coalesce && s->policy->coalesce && !t->group)
+    {
+        long long n = coalesced_slices(s, cpu, slice);
+        s->nr_coalesced += n - 1;
+        slice *= n;
+    }
+
+    size_t next = next_decision_time(s);
+    if (next != NO_TIME) 
+    {
+        size_t time_to_next = next > s->sim_time ? next - s->sim_time : 0;
+        if (time_to_next < slice) slice = time_to_next;
+    }
+
+    cpu->slice = slice;
+    cpu->clock = s->sim_time + slice;
+    cpu->busy_time += slice;
+    s->nr_slices++;
+    tp_fire(TP_PICK, cpu->curr->pid, cpu->id, slice);
+}
+
+static int tasks_runnable(struct scheduler *s)
+{
+    for (int i = 0; i < s->nr_cpus; i++)
+    {
+        if (!cpu_idle(&s->cpus[i])) return 1;
+    }
+
+    return 0;
+}
+
+/*
+    Each step advances to the earliest CPU clock. CPUs whose slice ends
+    there requeue their task, the trace and the balancer get their turn,
+    and then those CPUs pick again. Slices are clipped to the next event,
+    timer and balance point, so every CPU meets at those times.
+*/
+void sched_run(struct scheduler *s)
+{
+    #ifndef NO_TRACEPOINTS
+    struct tp_ring *prev_ring = tp_ring_current;
+    tp_ring_current = s->tp.enabled ? &s->tp : NULL;
+    #endif
+
+    while (!s->event_complete || tasks_runnable(s) || s->timers.nr_timers) 
+    {
+        size_t now = NO_TIME;
+        for (int i = 0; i < s->nr_cpus; i++)
+        {
+            if (s->cpus[i].clock < now) now = s->cpus[i].clock;
+        }
+        if (now == NO_TIME) break;
+
+        // state as of the top of this step, a restore carries on from here
+        if (s->checkpoint_path && !s->checkpoint_done && now >= s->checkpoint_at)
+        {
+            s->checkpoint_done = 1;
+            if (sched_checkpoint(s, s->checkpoint_path) < 0)
+            {
+                #ifdef DEBUG
+                fprintf(stderr, "cant write checkpoint %s\n", s->checkpoint_path);
+                #endif
+            }
+        }
+
+        s->sim_time = now;
+
+        for (int i = 0; i < s->nr_cpus; i++)
+        {
+            if (s->cpus[i].clock == now && s->cpus[i].curr) put_prev_task(s, &s->cpus[i]);
+        }
+
+        process_events(s);
+
+        if (s->nr_cpus > 1 && now >= s->next_balance)
+        {
+            load_balance(s);
+            s->next_balance = now + s->balance_interval;
+        }
+
+        for (int i = 0; i < s->nr_cpus; i++)
+        {
+            if (s->cpus[i].clock == now) pick_next_task(s, &s->cpus[i]);
+        }
+    }
+
+    if (s->pipe)
+    {
+        pipe_stop(s->pipe);
+        s->pipe = NULL;
+    }
+    out_flush(&s->output);
+    if (s->hist_format) hist_end(s);
+
+    #ifndef NO_TRACEPOINTS
+    tp_ring_current = prev_ring;
+    #endif
+}
+
+static void print_cpu_stats(struct scheduler *s, FILE *out)
+{
+    for (int i = 0; i < s->nr_cpus; i++)
+    {
+        struct cpu *cpu = &s->cpus[i];
+        double util = s->sim_time ? 100.0 * cpu->busy_time / s->sim_time : 0.0;
+
+        fprintf(out, "cpu %d: busy=%zu ms util=%.1f%% migrations in=%llu out=%llu\n",
+            cpu->id, cpu->busy_time, util, cpu->migrations_in, cpu->migrations_out);
+    }
+    fprintf(out, "migrations: %llu\n", s->nr_migrations);
+}
+
+/*
+    Applies the simulation option at argv[*i], consuming its argument if it
+    takes one. Returns 1 if argv[*i] was one, 0 if it is not a simulation
+    option and -1 if its argument is bad.
+*/
+int sched_parse_option(struct scheduler *s, int argc, char **argv, int *i)
+{
+    const char *opt = argv[*i];
+    int has_arg = *i + 1 < argc;
+
+    if (strcmp(opt, "-rq") == 0 && has_arg)
+    {
+        s->rq_ops = rq_ops_by_name(argv[++*i]);
+        return s->rq_ops ? 1 : -1;
+    }
+    else if (strcmp(opt, "-policy") == 0 && has_arg)
+    {
+        s->policy = policy_by_name(argv[++*i]);
+        return s->policy ? 1 : -1;
+    }
+    else if (strcmp(opt, "-map") == 0 && has_arg)
+    {
+        const char *mode = argv[++*i];
+        if (strcmp(mode, "linear") == 0) s->map_mode = MAP_LINEAR;
+        else if (strcmp(mode, "swiss") == 0) s->map_mode = MAP_SWISS;
+        else return -1;
+        return 1;
+    }
+    else if (strcmp(opt, "-cpus") == 0 && has_arg)
+    {
+        s->nr_cpus = atoi(argv[++*i]);
+        return s->nr_cpus < 1 ? -1 : 1;
+    }
+    else if (strcmp(opt, "-balance-interval") == 0 && has_arg)
+    {
+        long long interval = atoll(argv[++*i]);
+        if (interval < 1) return -1;
+        s->balance_interval = (size_t)interval;
+        return 1;
+    }
+    else if (strcmp(opt, "-out") == 0 && has_arg)
+    {
+        int format = out_format_parse(argv[++*i]);
+        if (format < 0) return -1;
+        s->out_format = format;
+        return 1;
+    }
+    else if (strcmp(opt, "-trace") == 0 && has_arg)
+    {
+        return tp_parse_mask(argv[++*i], &s->tp_mask) < 0 ? -1 : 1;
+    }
+    else if (strcmp(opt, "-trace-size") == 0 && has_arg)
+    {
+        long long size = atoll(argv[++*i]);
+        if (size < 1) return -1;
+        s->tp_size = (size_t)size;
+        return 1;
+    }
+    else if (strcmp(opt, "-coalesce") == 0)
+    {
+        s->coalesce = 1;
+        return 1;
+    }
+    else if (strcmp(opt, "-hist") == 0 && has_arg)
+    {
+        const char *format = argv[++*i];
+        if (strcmp(format, "json") == 0) s->hist_format = HIST_JSON;
+        else if (strcmp(format, "csv") == 0) s->hist_format = HIST_CSV;
+        else return -1;
+        return 1;
+    }
+    else if (strcmp(opt, "-hist-out") == 0 && has_arg)
+    {
+        s->hist_path = argv[++*i];
+        return 1;
+    }
+    else if (strcmp(opt, "-hist-tasks") == 0)
+    {
+        s->hist_tasks = 1;
+        return 1;
+    }
+    else if (strcmp(opt, "-checkpoint") == 0 && has_arg)
+    {
+        s->checkpoint_path = argv[++*i];
+        return 1;
+    }
+    else if (strcmp(opt, "-checkpoint-at") == 0 && has_arg)
+    {
+        long long at = atoll(argv[++*i]);
+        if (at < 0) return -1;
+        s->checkpoint_at = (size_t)at;
+        return 1;
+    }
+    else if (strcmp(opt, "-restore") == 0 && has_arg)
+    {
+        s->restore_path = argv[++*i];
+        return 1;
+    }
+    else if (strcmp(opt, "-stats") == 0)
+    {
+        s->print_stats = 1;
+        return 1;
+    }
+    else if (strcmp(opt, "-hugepages") == 0)
+    {
+        s->use_hugepages = 1;
+        return 1;
+    }
+    else if (strcmp(opt, "-pipeline") == 0)
+    {
+        s->pipeline = 1;
+        return 1;
+    }
+
+    return 0;
+}
+
+/*
+    Sets up a configured scheduler to replay trace and log to out. Both
+    stay owned by the caller. On failure the scheduler is left in a state
+    sched_destroy can clean up.
+*/
+static int sched_init_hist(struct scheduler *s)
+{
+    s->hist_out = s->hist_path ? fopen(s->hist_path, "w") : stderr;
+    if (!s->hist_out) return -1;
+
+    for (int m = 0; m < HIST_NR_METRICS; m++)
+    {
+        s->hist[m] = malloc(hist_size(HIST_GLOBAL_BITS));
+        if (!s->hist[m]) return -1;
+        hist_init(s->hist[m], HIST_GLOBAL_BITS);
+    }
+
+    if (slab_init(&s->hist_slab, HIST_NR_METRICS * hist_size(HIST_TASK_BITS), 0, s->use_hugepages) < 0) return -1;
+
+    hist_begin(s);
+    return 0;
+}
+
+int sched_init(struct scheduler *s, struct trace_reader *trace, FILE *out)
+{
+    s->trace = trace;
+    s->out = out;
+
+    if (s->policy->deadlines && !s->rq_ops->pick_deadline)
+    {
+        #ifdef DEBUG
+        fprintf(stderr, "policy %s needs a run queue with deadline picks\n", s->policy->name);
+        #endif
+        return -1;
+    }
+
+    // a checkpoint records where the trace was read up to, the reader thread is ahead of that
+    if (s->pipeline && s->checkpoint_path)
+    {
+        #ifdef DEBUG
+        fprintf(stderr, "-checkpoint does not work with -pipeline\n");
+        #endif
+        return -1;
+    }
+
+    if (out_open(&s->output, s->out_format, out, s->nr_cpus > 1) < 0) return -1;
+    if (tp_ring_init(&s->tp, s->tp_mask, s->tp_size, &s->sim_time) < 0) return -1;
+
+    if (slab_init(&s->task_slab, sizeof(struct task), 0, s->use_hugepages) < 0)
+    {
+        #ifdef DEBUG
+        fprintf(stderr, "cant init task slab\n");
+        #endif
+        return -1;
+    }
+
+    s->cpus = calloc(s->nr_cpus, sizeof(struct cpu));
+    if (!s->cpus)
+    {
+        #ifdef DEBUG
+        fprintf(stderr, "cant alloc cpus\n");
+        #endif
+        return -1;
+    }
+
+    if (rq_pool_init(&s->rq_pool, s->rq_ops) < 0)
+    {
+        #ifdef DEBUG
+        fprintf(stderr, "cant init run queue pool\n");
+        #endif
+        return -1;
+    }
+
+    for (int i = 0; i < s->nr_cpus; i++)
+    {
+        s->cpus[i].id = i;
+        if (rq_init(&s->cpus[i].run_queue, s->rq_ops, &s->rq_pool) < 0)
+        {
+            #ifdef DEBUG
+            fprintf(stderr, "cant init run queue\n");
+            #endif
+            return -1;
+        }
+        s->cpus[i].run_queue.track_avg = s->policy->deadlines;
+    }
+    s->next_balance = s->balance_interval;
+    tw_init(&s->timers, 0);
+
+    if (map_init_mode(&s->wake_queue_task_map, 11, NULL, s->map_mode) < 0) 
+    {
+        #ifdef DEBUG
+        fprintf(stderr, "cant init map\n");
+        #endif
+        return -1;
+    }
+
+    if (map_init_mode(&s->pid_map, 11, NULL, s->map_mode) < 0) 
+    {
+        #ifdef DEBUG
+        fprintf(stderr, "cant init pid map\n");
+        #endif
+        return -1;
+    }
+
+    if (map_init_mode(&s->group_map, 11, NULL, s->map_mode) < 0)
+    {
+        #ifdef DEBUG
+        fprintf(stderr, "cant init group map\n");
+        #endif
+        return -1;
+    }
+
+    if (s->hist_format && sched_init_hist(s) < 0)
+    {
+        #ifdef DEBUG
+        fprintf(stderr, "cant init histograms\n");
+        #endif
+        return -1;
+    }
+
+    if (s->restore_path && sched_restore(s, s->restore_path) < 0)
+    {
+        #ifdef DEBUG
+        fprintf(stderr, "cant restore %s\n", s->restore_path);
+        #endif
+        return -1;
+    }
+
+    // after the restore, which seeks the trace to where the checkpoint left it
+    if (s->pipeline && !(s->pipe = pipe_start(s->trace, &s->output))) return -1;
+    if (s->restore_path) return 0;
+
+    if (next_event(s, &s->last_command) <= 0) 
+    {
+        #ifdef DEBUG
+        fprintf(stderr, "file data format error\n");
+        #endif
+        return -1;
+    }
+
+    return 0;
+}
+
+unsigned long long sched_restructures(struct scheduler *s)
+{
+    unsigned long long restructures = 0;
+
+    for (int i = 0; i < s->nr_cpus; i++)
+    {
+        struct run_queue *rq = &s->cpus[i].run_queue;
+        restructures += rq->ops->restructures(rq);
+
+        for (struct task_group *g = s->groups; g; g = g->next)
+        {
+            restructures += g->cpus[i].rq.ops->restructures(&g->cpus[i].rq);
+        }
+    }
+
+    return restructures;
+}
+
+void sched_print_stats(struct scheduler *s, FILE *out)
+{
+    if (s->print_stats)
+    {
+        fprintf(out, "run queue: %s, restructures=%llu\n", s->rq_ops->name, sched_restructures(s));
+        fprintf(out, "slices: %llu picked, %llu coalesced\n", s->nr_slices, s->nr_coalesced);
+    }
+
+    if (s->print_stats || s->nr_cpus > 1)
+    {
+        print_cpu_stats(s, out);
+    }
+
+    tp_ring_dump(&s->tp, out);
+}
+
+void sched_print_summary(struct scheduler *s, FILE *out)
+{
+    unsigned long long *records = s->output.records;
+
+    fprintf(out, "sim_time=%zu events=%llu slices=%llu started=%llu woken=%llu exited=%llu\n",
+        s->sim_time, s->nr_events, s->nr_slices,
+        records[OUT_START], records[OUT_WAKEUP], records[OUT_EXIT]);
+}
+
+void sched_destroy(struct scheduler *s)
+{
+    if (s->pipe)
+    {
+        pipe_stop(s->pipe);
+        s->pipe = NULL;
+    }
+    out_close(&s->output);
+    tp_ring_destroy(&s->tp);
+    if (s->cpus)
+    {
+        for (int i = 0; i < s->nr_cpus; i++) rq_destroy(&s->cpus[i].run_queue);
+        free(s->cpus);
+        s->cpus = NULL;
+    }
+    while (s->groups)
+    {
+        struct task_group *g = s->groups;
+        s->groups = g->next;
+        for (int i = 0; i < s->nr_cpus; i++) rq_destroy(&g->cpus[i].rq);
+        free(g);
+    }
+    rq_pool_destroy(&s->rq_pool);
+    free_map(s->wake_queue_task_map);
+    free_map(s->pid_map);
+    free_map(s->group_map);
+    s->wake_queue_task_map = s->pid_map = s->group_map = NULL;
+    // also releases tasks still asleep at end of trace
+    slab_destroy(&s->task_slab);
+
+    for (int m = 0; m < HIST_NR_METRICS; m++)
+    {
+        free(s->hist[m]);
+        s->hist[m] = NULL;
+    }
+    slab_destroy(&s->hist_slab);
+    if (s->hist_out && s->hist_out != stderr) fclose(s->hist_out);
+    s->hist_out = NULL;
+}
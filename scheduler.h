@@ -0,0 +1,187 @@
+#ifndef _SCHEDULER_H
+#define _SCHEDULER_H
+#include <stdio.h>
+#include <stddef.h>
+#include "runqueue.h"
+#include "map.h"
+#include "slab.h"
+#include "trace.h"
+#include "output.h"
+#include "tracepoint.h"
+#include "histogram.h"
+#include "timer.h"
+#include "policy.h"
+#include "pipeline.h"
+
+#define NO_TIME     ((size_t)-1)
+
+/*
+    -hist: wait (runnable to picked), latency (started or woken to first
+    run) and slice length over the whole run, and per task with
+    -hist-tasks. A task's row is written when it exits, tasks still alive
+    and the totals at the end. Per-task histograms cost a cold cache line
+    or two per sample and ~3 KiB per live task, the totals next to nothing.
+*/
+enum hist_format
+{
+    HIST_OFF = 0,
+    HIST_JSON,
+    HIST_CSV,
+};
+
+enum hist_metric
+{
+    HIST_WAIT = 0,
+    HIST_LATENCY,
+    HIST_SLICE,
+    HIST_NR_METRICS,
+};
+
+#define HIST_TASK_BITS      3       // per task: within 12.5%
+#define HIST_GLOBAL_BITS    7       // whole run: within 1%
+
+/*
+    Task group, as in CFS group scheduling. On every CPU a group has an
+    entity (se) in its parent's queue there, weighted by the group's
+    shares, and a queue of its own (rq) for its tasks and the entities of
+    its child groups. Picking walks down from the CPU's queue through the
+    leftmost entities to a task, and a slice is charged to the task and to
+    each group entity above it.
+
+    se is queued while anything directly below it on that CPU is (running
+    included), so it only moves in or out of its parent's queue when the
+    group turns busy or idle there, and the walk up stops at the first
+    level that does not.
+*/
+struct group_cpu
+{
+    struct task se;
+    struct run_queue rq;
+    struct task_group *tg;
+    long long nr_busy;          // entities below, queued or running
+};
+
+struct task_group
+{
+    long long id;
+    struct task_group *parent;  // NULL: the root
+    unsigned int shares;
+    struct task_group *next;    // all groups, newest first
+    struct group_cpu cpus[];    // one per CPU
+};
+
+#define GROUP_MIN_SHARES    2
+#define GROUP_MAX_SHARES    (1 << 18)
+
+/*
+    One simulated CPU. The running task (curr) is kept out of the run queue
+    for the length of its slice, like CFS's put_prev/set_next, so other
+    CPUs can only ever pull tasks that are really waiting. With a single
+    CPU and a backend that can re-key in place it stays queued instead
+    (curr->on_rq). clock is when curr's slice ends, or when an idle CPU
+    next looks for work. h_nr_running counts the tasks queued on the CPU
+    at every level of the group tree.
+
+    Tasks started without a group during one timestamp wait on new_tasks
+    (linked through ->right, counted in h_nr_running already) and are
+    queued together once no other event can look at the queue first.
+*/
+struct cpu
+{
+    int id;
+    struct run_queue run_queue;     // own CFS queue and min_vruntime
+    struct task *curr;
+    long long h_nr_running;
+    struct task *new_tasks;
+    struct task *new_last;
+    long long nr_new;
+    size_t slice;
+    size_t clock;
+    size_t busy_time;
+    unsigned long long migrations_in;
+    unsigned long long migrations_out;
+};
+
+/*
+    Everything one simulation owns. Nothing in the simulator is global, so
+    any number of these can run side by side (see batch.c). The fields up
+    to tp_size are configuration, set before sched_init; the rest is
+    filled in by sched_init and torn down by sched_destroy.
+*/
+struct scheduler
+{
+    size_t min_granularity;
+    size_t sched_latency;
+    int nr_cpus;
+    size_t balance_interval;    // periodic load balance, ms (SMP only)
+    const struct rq_ops *rq_ops;
+    const struct sched_policy *policy;
+    int print_stats;
+    int coalesce;               // run repeated picks of the same task as one slice
+    int use_hugepages;
+    enum map_mode map_mode;     // layout of wake_queue_task_map and pid_map
+    enum out_format out_format;
+    unsigned int tp_mask;       // enabled tracepoints, see tracepoint.h
+    size_t tp_size;             // ring entries
+    enum hist_format hist_format;
+    const char *hist_path;      // NULL: stderr
+    int hist_tasks;             // per-task histograms too
+    const char *checkpoint_path;    // save the state here once sim_time reaches checkpoint_at
+    size_t checkpoint_at;
+    const char *restore_path;   // start from this checkpoint instead of the trace's start
+    int pipeline;               // read the trace and write the log on threads of their own
+
+    struct trace_reader *trace; // event source, text or binary
+    struct pipeline *pipe;      // -pipeline, while sched_run has events to read
+    FILE *out;                  // event log
+    struct output output;       // buffered writer in front of out
+    struct tp_ring tp;
+    size_t number_of_tasks;
+    size_t sim_time;
+    int event_complete;
+    struct input last_command;
+    struct cpu *cpus;
+    size_t next_balance;
+    unsigned long long nr_events;
+    unsigned long long nr_slices;
+    unsigned long long nr_coalesced;    // slices folded into a longer one
+    size_t max_tasks;           // peak number_of_tasks
+    unsigned long long nr_migrations;
+    long long queue_seq;        // fifo/rr: last queue position handed out
+    struct hash *wake_queue_task_map;
+    struct timer_wheel timers;  // timed sleeps, each also in wake_queue_task_map
+    struct hash *pid_map;       // pid -> task, for every live task (runnable or sleeping)
+    struct slab task_slab;      // every struct task, for its whole life
+    struct rq_pool rq_pool;     // nodes of rq_ops kept outside the tasks, one per entity
+    struct hash *group_map;     // group id -> se of its first CPU
+    struct task_group *groups;
+    FILE *hist_out;
+    struct hist *hist[HIST_NR_METRICS];     // whole run
+    struct slab hist_slab;      // per-task histograms, HIST_NR_METRICS each
+    int hist_rows;              // rows written so far
+    int checkpoint_done;
+};
+
+#define SCHEDULER_DEFAULTS                                  \
+    {                                                       \
+        .min_granularity = 4,       /* ms */                \
+        .sched_latency = 20,        /* ms */                \
+        .nr_cpus = 1,                                       \
+        .balance_interval = 20,     /* ms */                \
+        .rq_ops = &avl_rq_ops,                              \
+        .policy = &cfs_policy,                              \
+        .print_stats = 0,                                   \
+        .tp_size = TP_DEFAULT_SIZE,                         \
+    }
+
+int sched_parse_option(struct scheduler *s, int argc, char **argv, int *i);
+int sched_init(struct scheduler *s, struct trace_reader *trace, FILE *out);
+void sched_run(struct scheduler *s);
+unsigned long long sched_restructures(struct scheduler *s);
+void sched_print_stats(struct scheduler *s, FILE *out);
+void sched_print_summary(struct scheduler *s, FILE *out);
+void sched_destroy(struct scheduler *s);
+struct task_group *sched_new_group(struct scheduler *s, long long id, long long shares, long long parent);
+struct task_group *sched_find_group(struct scheduler *s, long long id);
+
+#endif
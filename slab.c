@@ -0,0 +1,137 @@
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include "slab.h"
+
+#define SLAB_ALIGN    16
+
+static inline size_t align_up(size_t v, size_t a)
+{
+    return (v + a - 1) & ~(a - 1);
+}
+
+int slab_init(struct slab *slab, size_t obj_size, size_t chunk_size, int use_hugepages)
+{
+    // free objects hold the free-list link in their first word
+    if (obj_size < sizeof(void *)) obj_size = sizeof(void *);
+
+    slab->obj_size = align_up(obj_size, SLAB_ALIGN);
+    slab->chunk_size = chunk_size ? chunk_size : SLAB_DEFAULT_CHUNK;
+    slab->use_hugepages = use_hugepages;
+    slab->free_list = NULL;
+    slab->cur = slab->end = NULL;
+    slab->chunks = NULL;
+    slab->nr_live = 0;
+    slab->nr_chunks = 0;
+
+    if (slab->chunk_size < align_up(sizeof(struct slab_chunk), SLAB_ALIGN) + slab->obj_size)
+    {
+        #ifdef DEBUG
+        fprintf(stderr, "slab chunk too small for object size %zu\n", obj_size);
+        #endif
+        return -1;
+    }
+
+    return 0;
+}
+
+static struct slab_chunk *chunk_alloc(struct slab *slab)
+{
+    struct slab_chunk *chunk = NULL;
+    size_t bytes = slab->chunk_size;
+
+    if (slab->use_hugepages)
+    {
+        bytes = align_up(bytes, SLAB_DEFAULT_CHUNK);
+        void *p = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (p == MAP_FAILED)
+        {
+            // no reserved huge pages, ask for transparent ones instead
+            p = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            #ifdef MADV_HUGEPAGE
+            if (p != MAP_FAILED) madvise(p, bytes, MADV_HUGEPAGE);
+            #endif
+        }
+
+        if (p != MAP_FAILED)
+        {
+            chunk = p;
+            chunk->mmapped = 1;
+        }
+    }
+
+    if (!chunk)
+    {
+        chunk = malloc(bytes);
+        if (!chunk) return NULL;
+        chunk->mmapped = 0;
+    }
+
+    chunk->bytes = bytes;
+    chunk->next = slab->chunks;
+    slab->chunks = chunk;
+    slab->nr_chunks++;
+
+    slab->cur = (char *)chunk + align_up(sizeof(struct slab_chunk), SLAB_ALIGN);
+    slab->end = (char *)chunk + bytes;
+
+    return chunk;
+}
+
+void *slab_alloc(struct slab *slab)
+{
+    void *obj = slab->free_list;
+
+    if (obj)
+    {
+        slab->free_list = *(void **)obj;
+    }
+    else
+    {
+        if (!slab->cur || slab->cur + slab->obj_size > slab->end)
+        {
+            if (!chunk_alloc(slab))
+            {
+                #ifdef DEBUG
+                fprintf(stderr, "slab chunk alloc failed\n");
+                #endif
+                return NULL;
+            }
+        }
+
+        obj = slab->cur;
+        slab->cur += slab->obj_size;
+    }
+
+    slab->nr_live++;
+    return obj;
+}
+
+void slab_free(struct slab *slab, void *obj)
+{
+    if (!obj) return;
+
+    *(void **)obj = slab->free_list;
+    slab->free_list = obj;
+    slab->nr_live--;
+}
+
+void slab_destroy(struct slab *slab)
+{
+    struct slab_chunk *chunk = slab->chunks;
+
+    while (chunk)
+    {
+        struct slab_chunk *next = chunk->next;
+        if (chunk->mmapped) munmap(chunk, chunk->bytes);
+        else free(chunk);
+        chunk = next;
+    }
+
+    slab->chunks = NULL;
+    slab->free_list = NULL;
+    slab->cur = slab->end = NULL;
+    slab->nr_live = 0;
+    slab->nr_chunks = 0;
+}
@@ -0,0 +1,39 @@
+#ifndef _SLAB_H
+#define _SLAB_H
+#include <stddef.h>
+
+#define SLAB_DEFAULT_CHUNK    (2UL << 20)     // 2 MiB, one huge page
+
+struct slab_chunk
+{
+    struct slab_chunk *next;
+    size_t bytes;
+    int mmapped;
+};
+
+/*
+    Fixed-size object allocator. Objects are carved out of large chunks
+    and recycled through an intrusive free list, so steady-state alloc and
+    free are a couple of pointer moves. Chunks are only returned to the
+    system by slab_destroy. With use_hugepages the chunks are mmap'd with
+    MAP_HUGETLB, falling back to THP-advised memory and then to malloc.
+*/
+struct slab
+{
+    size_t obj_size;
+    size_t chunk_size;
+    int use_hugepages;
+    void *free_list;
+    char *cur;                  // bump pointer into the newest chunk
+    char *end;
+    struct slab_chunk *chunks;
+    size_t nr_live;
+    size_t nr_chunks;
+};
+
+int slab_init(struct slab *slab, size_t obj_size, size_t chunk_size, int use_hugepages);
+void *slab_alloc(struct slab *slab);
+void slab_free(struct slab *slab, void *obj);
+void slab_destroy(struct slab *slab);
+
+#endif
@@ -0,0 +1,136 @@
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include "spsc.h"
+
+#define SPSC_YIELDS     16      // before a side goes to sleep
+
+struct spsc_ring *spsc_create(size_t slot_size, size_t nr_slots)
+{
+    size_t size = 1;
+    while (size < nr_slots) size <<= 1;
+
+    // rounded up to the alignment, as aligned_alloc wants
+    size_t bytes = (sizeof(struct spsc_ring) + SPSC_CACHELINE - 1) & ~(size_t)(SPSC_CACHELINE - 1);
+    struct spsc_ring *r = aligned_alloc(SPSC_CACHELINE, bytes);
+    if (!r) return NULL;
+
+    memset(r, 0, sizeof(*r));
+    r->slots = malloc(size * slot_size);
+    if (!r->slots)
+    {
+        free(r);
+        return NULL;
+    }
+
+    atomic_init(&r->tail, 0);
+    atomic_init(&r->head, 0);
+    atomic_init(&r->closed, 0);
+    atomic_init(&r->waiting, 0);
+    r->slot_size = slot_size;
+    r->mask = size - 1;
+    pthread_mutex_init(&r->lock, NULL);
+    pthread_cond_init(&r->cond, NULL);
+    return r;
+}
+
+void spsc_destroy(struct spsc_ring *r)
+{
+    if (!r) return;
+
+    pthread_mutex_destroy(&r->lock);
+    pthread_cond_destroy(&r->cond);
+    free(r->slots);
+    free(r);
+}
+
+/*
+    The index stores and the waiting loads are sequentially consistent,
+    as are the waiter's increment and its re-check, so either the waiter
+    sees the new index or the publisher sees the waiter and wakes it.
+*/
+static void wake(struct spsc_ring *r)
+{
+    if (atomic_load(&r->waiting))
+    {
+        pthread_mutex_lock(&r->lock);
+        pthread_cond_broadcast(&r->cond);
+        pthread_mutex_unlock(&r->lock);
+    }
+}
+
+// producer: make every pushed slot visible
+void spsc_flush(struct spsc_ring *r)
+{
+    atomic_store(&r->tail, r->push);
+    wake(r);
+}
+
+// consumer: hand every popped slot back
+void spsc_publish_head(struct spsc_ring *r)
+{
+    atomic_store(&r->head, r->pop);
+    wake(r);
+}
+
+// either side; a producer flushes first
+void spsc_close(struct spsc_ring *r)
+{
+    atomic_store(&r->closed, 1);
+    pthread_mutex_lock(&r->lock);
+    pthread_cond_broadcast(&r->cond);
+    pthread_mutex_unlock(&r->lock);
+}
+
+static int slot_ready(struct spsc_ring *r)
+{
+    r->head_cache = atomic_load(&r->head);
+    return r->push - r->head_cache <= r->mask || atomic_load(&r->closed);
+}
+
+static int front_ready(struct spsc_ring *r)
+{
+    r->tail_cache = atomic_load(&r->tail);
+    return r->pop != r->tail_cache || atomic_load(&r->closed);
+}
+
+static void wait_for(struct spsc_ring *r, int (*ready)(struct spsc_ring *r))
+{
+    for (int i = 0; i < SPSC_YIELDS; i++)
+    {
+        if (ready(r)) return;
+        sched_yield();
+    }
+
+    pthread_mutex_lock(&r->lock);
+    atomic_fetch_add(&r->waiting, 1);
+    while (!ready(r)) pthread_cond_wait(&r->cond, &r->lock);
+    atomic_fetch_sub(&r->waiting, 1);
+    pthread_mutex_unlock(&r->lock);
+}
+
+// the ring is full as far as the producer knows
+void *spsc_wait_slot(struct spsc_ring *r)
+{
+    // the consumer may be waiting for the slots not yet published
+    spsc_flush(r);
+    wait_for(r, slot_ready);
+
+    if (atomic_load(&r->closed)) return NULL;
+    return r->slots + (r->push & r->mask) * r->slot_size;
+}
+
+// the ring is empty as far as the consumer knows
+void *spsc_wait_front(struct spsc_ring *r)
+{
+    spsc_publish_head(r);
+    wait_for(r, front_ready);
+
+    // a producer that closed has flushed, so this sees its last slots
+    if (r->pop == r->tail_cache)
+    {
+        r->tail_cache = atomic_load(&r->tail);
+        if (r->pop == r->tail_cache) return NULL;
+    }
+    return r->slots + (r->pop & r->mask) * r->slot_size;
+}
@@ -0,0 +1,80 @@
+#ifndef _SPSC_H
+#define _SPSC_H
+#include <stddef.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#define SPSC_CACHELINE      64
+#define SPSC_BATCH          64      // slots pushed / popped between publishes
+
+/*
+    Single-producer single-consumer ring of fixed-size slots, lock-free
+    on the fast path. Each side works on its own cache line: a private
+    index that runs ahead of the published one, which the other side only
+    sees every SPSC_BATCH slots (or on spsc_flush), and a cached copy of
+    the other side's index, so the shared lines only move when a side
+    catches up with what it last saw.
+
+    The producer fills spsc_slot() in place and commits it with
+    spsc_push(); the consumer reads spsc_front() and releases it with
+    spsc_pop(). A side that runs out of slots publishes what it holds,
+    yields a few times and then sleeps on a condition variable until the
+    other side publishes, so the stages also work on a single CPU.
+    spsc_close() ends the stream from either side: the consumer still
+    drains what was pushed, then gets NULL, and a producer gets NULL.
+*/
+struct spsc_ring
+{
+    // producer
+    _Alignas(SPSC_CACHELINE) atomic_size_t tail;   // published
+    size_t push;                    // next slot to fill
+    size_t head_cache;              // head as last seen
+
+    // consumer
+    _Alignas(SPSC_CACHELINE) atomic_size_t head;   // published
+    size_t pop;                     // next slot to read
+    size_t tail_cache;              // tail as last seen
+
+    _Alignas(SPSC_CACHELINE) unsigned char *slots;
+    size_t slot_size;
+    size_t mask;                    // nr slots - 1, a power of two
+    atomic_int closed;
+    atomic_int waiting;             // a side sleeps on cond
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+};
+
+// nr_slots is rounded up to a power of two
+struct spsc_ring *spsc_create(size_t slot_size, size_t nr_slots);
+void spsc_destroy(struct spsc_ring *r);
+void spsc_flush(struct spsc_ring *r);
+void spsc_close(struct spsc_ring *r);
+void *spsc_wait_slot(struct spsc_ring *r);
+void *spsc_wait_front(struct spsc_ring *r);
+void spsc_publish_head(struct spsc_ring *r);
+
+// NULL once the consumer has closed the ring
+static inline void *spsc_slot(struct spsc_ring *r)
+{
+    if (r->push - r->head_cache > r->mask) return spsc_wait_slot(r);
+    return r->slots + (r->push & r->mask) * r->slot_size;
+}
+
+static inline void spsc_push(struct spsc_ring *r)
+{
+    if (++r->push % SPSC_BATCH == 0) spsc_flush(r);
+}
+
+// NULL once the ring is closed and drained
+static inline void *spsc_front(struct spsc_ring *r)
+{
+    if (r->pop == r->tail_cache) return spsc_wait_front(r);
+    return r->slots + (r->pop & r->mask) * r->slot_size;
+}
+
+static inline void spsc_pop(struct spsc_ring *r)
+{
+    if (++r->pop % SPSC_BATCH == 0) spsc_publish_head(r);
+}
+
+#endif
@@ -0,0 +1,257 @@
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "task.h"
+#include "swissmap.h"
+#include "tracepoint.h"
+
+/*
+    Swiss-table layout: table_size slots in table_size / 16 groups. A key's
+    hash splits into h1 (which group to start at) and h2 (a 7-bit tag kept
+    in the control byte). A probe visits whole groups in triangular order
+    and only compares keys whose tag matched, so most misses touch one
+    16-byte control group and no slots at all.
+*/
+
+#define MAX_LOAD_NUM    7
+#define MAX_LOAD_DEN    8
+
+// the multiplicative default hash leaves weak low bits, so mix fully
+static inline unsigned long long mix(struct hash *map, long long key)
+{
+    unsigned long long h = map->hash_fn(key);
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    return h;
+}
+
+static inline signed char h2(unsigned long long h)
+{
+    return (signed char)(h & 0x7f);
+}
+
+static inline long long nr_groups(struct hash *map)
+{
+    return map->table_size / SWISS_GROUP;
+}
+
+static inline long long h1_group(struct hash *map, unsigned long long h)
+{
+    return (long long)((h >> 7) & (nr_groups(map) - 1));
+}
+
+// bit i set when ctrl[i] == tag
+static inline unsigned int group_match(const signed char *ctrl, signed char tag)
+{
+#ifdef __SSE2__
+    __m128i group = _mm_loadu_si128((const __m128i *)ctrl);
+    return (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8(tag)));
+#else
+    unsigned int mask = 0;
+    for (int i = 0; i < SWISS_GROUP; i++)
+    {
+        if (ctrl[i] == tag) mask |= 1u << i;
+    }
+    return mask;
+#endif
+}
+
+// bit i set when ctrl[i] is EMPTY or DELETED (both are negative)
+static inline unsigned int group_match_free(const signed char *ctrl)
+{
+#ifdef __SSE2__
+    __m128i group = _mm_loadu_si128((const __m128i *)ctrl);
+    return (unsigned int)_mm_movemask_epi8(group);
+#else
+    unsigned int mask = 0;
+    for (int i = 0; i < SWISS_GROUP; i++)
+    {
+        if (ctrl[i] < 0) mask |= 1u << i;
+    }
+    return mask;
+#endif
+}
+
+static inline unsigned int group_match_empty(const signed char *ctrl)
+{
+    return group_match(ctrl, CTRL_EMPTY);
+}
+
+static int table_alloc(struct hash *map, long long size)
+{
+    struct key_value_pair *slots = calloc(size, sizeof(struct key_value_pair));
+    signed char *ctrl = malloc(size);
+    if (!slots || !ctrl)
+    {
+        #ifdef DEBUG
+        fprintf(stderr, "swiss alloc failed!\n");
+        #endif
+        free(slots);
+        free(ctrl);
+        return -1;
+    }
+
+    memset(ctrl, CTRL_EMPTY, size);
+    map->hashmap = slots;
+    map->ctrl = ctrl;
+    map->table_size = size;
+    map->mask = size - 1;
+    map->nr_deleted = 0;
+    return 0;
+}
+
+int swiss_init(struct hash *map, long long no_of_slots)
+{
+    long long size = SWISS_GROUP;
+    while (size < no_of_slots) size <<= 1;
+
+    return table_alloc(map, size);
+}
+
+// slot index holding key, or -1
+static long long find(struct hash *map, long long key, unsigned long long h)
+{
+    long long gmask = nr_groups(map) - 1;
+    long long g = h1_group(map, h);
+    signed char tag = h2(h);
+
+    for (long long step = 1; step <= nr_groups(map); step++)
+    {
+        const signed char *ctrl = map->ctrl + g * SWISS_GROUP;
+
+        for (unsigned int m = group_match(ctrl, tag); m; m &= m - 1)
+        {
+            long long index = g * SWISS_GROUP + __builtin_ctz(m);
+            if (map->hashmap[index].key == key) return index;
+        }
+
+        // a group with an EMPTY slot ends every probe that reaches it
+        if (group_match_empty(ctrl)) return -1;
+
+        g = (g + step) & gmask;
+    }
+
+    return -1;
+}
+
+// first EMPTY or DELETED slot along key's probe sequence
+static long long find_free(struct hash *map, unsigned long long h)
+{
+    long long gmask = nr_groups(map) - 1;
+    long long g = h1_group(map, h);
+
+    for (long long step = 1; step <= nr_groups(map); step++)
+    {
+        unsigned int m = group_match_free(map->ctrl + g * SWISS_GROUP);
+        if (m) return g * SWISS_GROUP + __builtin_ctz(m);
+
+        g = (g + step) & gmask;
+    }
+
+    return -1;
+}
+
+// rebuild at new_size, also drops every DELETED marker
+static int resize(struct hash *map, long long new_size)
+{
+    struct key_value_pair *old = map->hashmap;
+    signed char *old_ctrl = map->ctrl;
+    long long old_size = map->table_size;
+
+    if (table_alloc(map, new_size) < 0)
+    {
+        map->hashmap = old;
+        map->ctrl = old_ctrl;
+        map->table_size = old_size;
+        map->mask = old_size - 1;
+        return -1;
+    }
+
+    for (long long i = 0; i < old_size; i++)
+    {
+        if (old_ctrl[i] >= 0)
+        {
+            unsigned long long h = mix(map, old[i].key);
+            long long index = find_free(map, h);
+            map->ctrl[index] = h2(h);
+            map->hashmap[index] = old[i];
+        }
+    }
+
+    free(old);
+    free(old_ctrl);
+    tp_fire(TP_REHASH, -1, old_size, new_size);
+    return 0;
+}
+
+struct task *swiss_lookup(struct hash *map, long long key)
+{
+    long long index = find(map, key, mix(map, key));
+    return index < 0 ? NULL : map->hashmap[index].val;
+}
+
+void swiss_insert(struct hash *map, long long key, struct task *val)
+{
+    unsigned long long h = mix(map, key);
+    long long index = find(map, key, h);
+
+    if (index >= 0) // overwrite
+    {
+        map->hashmap[index].val = val;
+        return;
+    }
+
+    // tombstones count against the load: if they are most of it, compact in place
+    if ((map->num_of_elements + map->nr_deleted + 1) * MAX_LOAD_DEN > map->table_size * MAX_LOAD_NUM)
+    {
+        long long new_size = map->table_size;
+        if (map->num_of_elements * 2 * MAX_LOAD_DEN > map->table_size * MAX_LOAD_NUM) new_size *= 2;
+        if (resize(map, new_size) < 0 && map->num_of_elements + 1 >= map->table_size) return;
+    }
+
+    index = find_free(map, h);
+    if (index < 0) return;
+
+    if (map->ctrl[index] == CTRL_DELETED) map->nr_deleted--;
+    map->ctrl[index] = h2(h);
+    map->hashmap[index].key = key;
+    map->hashmap[index].val = val;
+    map->num_of_elements++;
+}
+
+/*
+    A slot can go straight back to EMPTY when its group still has an EMPTY
+    slot: then no probe ever walked past this group, since inserts only
+    move on from groups with no free slot at all. Otherwise leave a
+    DELETED marker so longer probe chains stay intact.
+*/
+void swiss_delete(struct hash *map, long long key)
+{
+    long long index = find(map, key, mix(map, key));
+    if (index < 0) return;
+
+    const signed char *group = map->ctrl + (index & ~(long long)(SWISS_GROUP - 1));
+    if (group_match_empty(group))
+    {
+        map->ctrl[index] = CTRL_EMPTY;
+    }
+    else
+    {
+        map->ctrl[index] = CTRL_DELETED;
+        map->nr_deleted++;
+    }
+
+    map->hashmap[index].val = NULL;
+    map->num_of_elements--;
+}
+
+void swiss_free(struct hash *map)
+{
+    free(map->ctrl);
+    map->ctrl = NULL;
+}
@@ -0,0 +1,18 @@
+#ifndef _SWISSMAP_H
+#define _SWISSMAP_H
+#include "map.h"
+
+#define SWISS_GROUP     16
+
+// control bytes: FULL slots hold the 7-bit tag (0..127)
+#define CTRL_EMPTY      ((signed char)-128)
+#define CTRL_DELETED    ((signed char)-2)
+
+// MAP_SWISS backend of map.c, not meant to be called directly
+int swiss_init(struct hash *map, long long no_of_slots);
+struct task *swiss_lookup(struct hash *map, long long key);
+void swiss_insert(struct hash *map, long long key, struct task *val);
+void swiss_delete(struct hash *map, long long key);
+void swiss_free(struct hash *map);
+
+#endif
@@ -0,0 +1,75 @@
+#ifndef _TASK_H
+#define _TASK_H
+
+struct hist;
+struct task_group;
+
+/*
+    A schedulable task, or the entity a task group is queued as in its
+    parent's queue (is_group). The three link pointers are shared by
+    whichever run-queue backend the simulator was started with:
+
+        avl, rbtree : left / right child, parent
+        cavl        : none, its node is in the queues' shared pool (slot)
+        pheap       : left = first child, right = next sibling,
+                      parent = previous sibling (or parent for a first child)
+        bucket      : left / right = prev / next in the bucket list
+
+    A task in a timed sleep is on no run queue, so the timer wheel
+    (timer.h) borrows left / right as prev / next in its slot list, and
+    min_deadline for its expiry.
+*/
+struct task
+{
+    long long vmruntime;
+    long long remaining_time;
+    long long pid;
+    union
+    {
+        long long height;   // avl
+        long long color;    // rbtree
+        long long slot;     // cavl: index of its node, for the entity's whole life
+    };
+    int on_rq;              // 1 while linked in the run queue, 0 while sleeping or running
+    int cpu;                // CPU whose run queue holds (or last held) the task
+    unsigned int weight;        // load weight of its nice level
+    unsigned int inv_weight;    // 2^32 / weight
+    unsigned int vruntime_frac; // vmruntime below 1 ms, in 2^-32 ms
+    unsigned char wake_pending; // started or woken, has not run since
+    unsigned char is_group;     // the entity of a task group, see scheduler.h
+    unsigned short timer_slot;  // timer wheel slot + 1 while a timed sleep is armed, else 0
+    long long runnable_since;   // when it last became runnable
+    struct hist *hist;          // per-task histograms with -hist, else NULL
+    struct task_group *group;   // group whose queue it goes on, NULL: the CPU's own
+    union
+    {
+        long long deadline;     // eevdf: virtual deadline of its current request
+        long long time_slice;   // rr: ms left of its quantum
+    };
+    union
+    {
+        long long min_deadline; // eevdf: earliest deadline in its avl subtree
+        long long expires;      // timer wheel, while in a timed sleep
+    };
+    long long vlag;             // eevdf: V - vruntime when it left its queue
+    struct task *left;
+    struct task *right;
+    struct task *parent;
+};
+
+// compare vmruntime + pid as vmruntime maybe same
+static inline int task_key_compare(long long v1, long long p1, long long v2, long long p2)
+{
+    if (v1 < v2) return -1;
+    if (v1 > v2) return +1;
+    if (p1 < p2) return -1;
+    if (p1 > p2) return +1;
+    return 0;
+}
+
+static inline int task_compare(const struct task *a, const struct task *b)
+{
+    return task_key_compare(a->vmruntime, a->pid, b->vmruntime, b->pid);
+}
+
+#endif
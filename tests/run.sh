@@ -0,0 +1,20 @@
+#!/bin/sh
+# usage: tests/run.sh [MAIN]
+# Replays every tests/*.txt trace with MAIN (./main by default) and
+# compares the event log with the trace's .expected file.
+
+MAIN=${1:-./main}
+DIR=$(dirname "$0")
+failed=0
+
+for trace in "$DIR"/*.txt; do
+    expected="${trace%.txt}.expected"
+    if timeout 10 "$MAIN" -i "$trace" 2>/dev/null | cmp -s - "$expected"; then
+        echo "ok   $(basename "$trace")"
+    else
+        echo "FAIL $(basename "$trace")"
+        failed=1
+    fi
+done
+
+exit $failed
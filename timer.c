@@ -0,0 +1,216 @@
+#include <stddef.h>
+#include <string.h>
+#include "timer.h"
+
+void tw_init(struct timer_wheel *tw, long long now)
+{
+    memset(tw, 0, sizeof(*tw));
+    tw->clk = now;
+    tw->next_expiry = TW_NO_EXPIRY;
+}
+
+static inline unsigned long long rotl(unsigned long long x, unsigned int r)
+{
+    r &= 63;
+    return r ? (x << r) | (x >> (64 - r)) : x;
+}
+
+static inline unsigned long long rotr(unsigned long long x, unsigned int r)
+{
+    r &= 63;
+    return r ? (x >> r) | (x << (64 - r)) : x;
+}
+
+// appends t to the slot for its expiry, relative to clk
+static void place(struct timer_wheel *tw, struct task *t)
+{
+    unsigned long long delta = t->expires > tw->clk ? (unsigned long long)(t->expires - tw->clk) : 0;
+    int level = (63 - __builtin_clzll(delta | 1)) / TW_BITS;
+    long long at = t->expires;
+
+    if (level >= TW_LEVELS)
+    {
+        // out of range: park in the top level's farthest slot, it is placed again when that cascades
+        level = TW_LEVELS - 1;
+        at = tw->clk + (1LL << (TW_BITS * TW_LEVELS)) - 1;
+    }
+
+    int slot = (int)((at >> (TW_BITS * level)) & TW_MASK);
+    struct tw_slot *s = &tw->slots[level][slot];
+
+    t->left = s->tail;
+    t->right = NULL;
+    if (s->tail) s->tail->right = t;
+    else s->head = t;
+    s->tail = t;
+
+    tw->pending[level] |= 1ULL << slot;
+    t->timer_slot = (unsigned short)(level * TW_SIZE + slot + 1);
+}
+
+static void unlink_timer(struct timer_wheel *tw, struct task *t)
+{
+    int level = (t->timer_slot - 1) / TW_SIZE;
+    int slot = (t->timer_slot - 1) % TW_SIZE;
+    struct tw_slot *s = &tw->slots[level][slot];
+
+    if (t->left) t->left->right = t->right;
+    else s->head = t->right;
+    if (t->right) t->right->left = t->left;
+    else s->tail = t->left;
+
+    if (!s->head) tw->pending[level] &= ~(1ULL << slot);
+    t->left = t->right = NULL;
+    t->timer_slot = 0;
+}
+
+void tw_arm(struct timer_wheel *tw, struct task *t, long long expires)
+{
+    t->expires = expires;
+    place(tw, t);
+    tw->nr_timers++;
+    if (tw->next_expiry != TW_UNKNOWN && expires < tw->next_expiry) tw->next_expiry = expires;
+}
+
+void tw_cancel(struct timer_wheel *tw, struct task *t)
+{
+    unlink_timer(tw, t);
+    tw->nr_timers--;
+    if (t->expires == tw->next_expiry) tw->next_expiry = tw->nr_timers ? TW_UNKNOWN : TW_NO_EXPIRY;
+}
+
+/*
+    Moves clk forward to, which must not pass any timer. Every upper-level
+    slot whose span clk enters on the way cascades: its timers are placed
+    again relative to the new clk, which puts them on a lower level (or
+    back on the same slot, for one that is a whole turn further out).
+*/
+static void advance_clk(struct timer_wheel *tw, long long to)
+{
+    long long from = tw->clk;
+    tw->clk = to;
+
+    for (int level = 1; level < TW_LEVELS; level++)
+    {
+        int shift = TW_BITS * level;
+        long long crossed = (to >> shift) - (from >> shift);
+        if (crossed <= 0) break;    // upper levels cross even fewer slots
+
+        unsigned long long mask = crossed >= TW_SIZE ? ~0ULL
+            : rotl((1ULL << crossed) - 1, (unsigned int)((from >> shift) + 1));
+        unsigned long long due = tw->pending[level] & mask;
+
+        while (due)
+        {
+            int slot = __builtin_ctzll(due);
+            struct task *t = tw->slots[level][slot].head;
+
+            due &= due - 1;
+            tw->slots[level][slot].head = tw->slots[level][slot].tail = NULL;
+            tw->pending[level] &= ~(1ULL << slot);
+
+            while (t)
+            {
+                struct task *next = t->right;
+                place(tw, t);
+                t = next;
+            }
+        }
+    }
+}
+
+/*
+    Earliest expiry. Level 0 slots are one ms each, so the first pending
+    one is exact. An upper level slot only bounds its timers by its span,
+    so pending slots are walked in time order until one starts after the
+    best expiry found. That is usually just the first, unless it only
+    holds timers parked there from beyond the top level's range.
+*/
+long long tw_find_next(struct timer_wheel *tw)
+{
+    long long best = TW_NO_EXPIRY;
+
+    for (int level = 0; level < TW_LEVELS; level++)
+    {
+        int shift = TW_BITS * level;
+        long long base = (tw->clk >> shift) + (level ? 1 : 0);
+        unsigned long long bits = rotr(tw->pending[level], (unsigned int)(base & TW_MASK));
+
+        while (bits)
+        {
+            int k = __builtin_ctzll(bits);
+            // unsigned, a clk before 0 must not shift a negative value
+            long long start = (long long)((unsigned long long)(base + k) << shift);
+
+            if (start >= best) break;
+            if (level == 0)
+            {
+                best = start;
+                break;
+            }
+
+            for (struct task *t = tw->slots[level][(base + k) & TW_MASK].head; t; t = t->right)
+            {
+                if (t->expires < best) best = t->expires;
+            }
+            bits &= bits - 1;
+        }
+    }
+
+    tw->next_expiry = best;
+    return best;
+}
+
+struct task *tw_expire(struct timer_wheel *tw, long long now)
+{
+    struct task *head = NULL, *tail = NULL;
+
+    if (!tw->nr_timers)
+    {
+        tw->clk = now;
+        return NULL;
+    }
+
+    for (long long next = tw_next_expiry(tw); next <= now; next = tw_next_expiry(tw))
+    {
+        advance_clk(tw, next);
+
+        // a level 0 slot only ever holds timers of one ms
+        int slot = (int)(next & TW_MASK);
+        struct tw_slot *s = &tw->slots[0][slot];
+
+        for (struct task *t = s->head; t; t = t->right)
+        {
+            t->timer_slot = 0;
+            tw->nr_timers--;
+        }
+        if (tail) tail->right = s->head;
+        else head = s->head;
+        s->head->left = tail;
+        tail = s->tail;
+
+        s->head = s->tail = NULL;
+        tw->pending[0] &= ~(1ULL << slot);
+        tw->next_expiry = tw->nr_timers ? TW_UNKNOWN : TW_NO_EXPIRY;
+    }
+
+    if (now > tw->clk) advance_clk(tw, now);
+    return head;
+}
+
+void tw_visit(struct timer_wheel *tw, struct rq_visitor *v)
+{
+    v->word(v, (unsigned long long *)&tw->clk);
+    v->word(v, (unsigned long long *)&tw->next_expiry);
+    v->word(v, (unsigned long long *)&tw->nr_timers);
+
+    for (int level = 0; level < TW_LEVELS; level++)
+    {
+        v->word(v, &tw->pending[level]);
+        for (int slot = 0; slot < TW_SIZE; slot++)
+        {
+            v->ptr(v, &tw->slots[level][slot].head);
+            v->ptr(v, &tw->slots[level][slot].tail);
+        }
+    }
+}
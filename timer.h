@@ -0,0 +1,62 @@
+#ifndef _TIMER_H
+#define _TIMER_H
+#include <limits.h>
+#include "task.h"
+#include "runqueue.h"
+
+/*
+    Hierarchical timer wheel for timed sleeps: TW_LEVELS levels of
+    TW_SIZE slots, where a slot on level L spans TW_SIZE^L ms. A timer
+    goes on the lowest level that covers its distance from clk, in the
+    slot of its expiry time, so arming and cancelling are O(1) list
+    operations. When clk moves into a later slot of an upper level, that
+    slot's timers cascade down towards level 0, whose slots are 1 ms
+    each and fire as one batch.
+
+    Slots are FIFO lists through the sleeping task's left / right links
+    (free while it is off every run queue), its expiry is task->expires
+    and task->timer_slot says which slot it is on. Timers due in the same
+    ms fire in the order they reached their level 0 slot.
+*/
+#define TW_BITS             6
+#define TW_SIZE             (1 << TW_BITS)
+#define TW_MASK             (TW_SIZE - 1)
+#define TW_LEVELS           6               // 2^36 ms, further out is re-checked on the way down
+#define TW_NO_EXPIRY        LLONG_MAX
+#define TW_UNKNOWN          (-1LL)
+
+struct tw_slot
+{
+    struct task *head;
+    struct task *tail;
+};
+
+struct timer_wheel
+{
+    long long clk;                          // every timer before clk has fired
+    long long next_expiry;                  // TW_NO_EXPIRY when empty, TW_UNKNOWN until recomputed
+    long long nr_timers;
+    unsigned long long pending[TW_LEVELS];  // bit per non-empty slot
+    struct tw_slot slots[TW_LEVELS][TW_SIZE];
+};
+
+void tw_init(struct timer_wheel *tw, long long now);
+void tw_arm(struct timer_wheel *tw, struct task *t, long long expires);
+void tw_cancel(struct timer_wheel *tw, struct task *t);
+long long tw_find_next(struct timer_wheel *tw);
+// unlinks every timer due at or before now, as a list through task->right in firing order
+struct task *tw_expire(struct timer_wheel *tw, long long now);
+// checkpoints, like rq_ops->visit
+void tw_visit(struct timer_wheel *tw, struct rq_visitor *v);
+
+static inline int tw_armed(const struct task *t)
+{
+    return t->timer_slot != 0;
+}
+
+static inline long long tw_next_expiry(struct timer_wheel *tw)
+{
+    return tw->next_expiry != TW_UNKNOWN ? tw->next_expiry : tw_find_next(tw);
+}
+
+#endif
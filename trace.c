@@ -0,0 +1,346 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "trace.h"
+
+const char *trace_action_names[TRACE_NR_ACTIONS] = {
+    [TRACE_START]  = "START",
+    [TRACE_SLEEP]  = "SLEEP",
+    [TRACE_WAKEUP] = "WAKEUP",
+    [TRACE_EXIT]   = "EXIT",
+    [TRACE_GROUP]  = "GROUP",
+};
+
+int trace_action_parse(const char *name)
+{
+    for (int i = 0; i < TRACE_NR_ACTIONS; i++)
+    {
+        if (strcmp(name, trace_action_names[i]) == 0) return i;
+    }
+
+    return TRACE_UNKNOWN;
+}
+
+static inline unsigned long long zigzag(long long v)
+{
+    return ((unsigned long long)v << 1) ^ (unsigned long long)(v >> 63);
+}
+
+static inline long long unzigzag(unsigned long long v)
+{
+    return (long long)(v >> 1) ^ -(long long)(v & 1);
+}
+
+static inline unsigned long long get_le(const unsigned char *p, int bytes)
+{
+    unsigned long long v = 0;
+    for (int i = bytes - 1; i >= 0; i--) v = (v << 8) | p[i];
+    return v;
+}
+
+static inline void put_le(unsigned char *p, unsigned long long v, int bytes)
+{
+    for (int i = 0; i < bytes; i++, v >>= 8) p[i] = v & 0xff;
+}
+
+// LEB128, returns 0 if the varint runs past end
+static inline int get_varint(const unsigned char **pos, const unsigned char *end, long long *v)
+{
+    const unsigned char *p = *pos;
+    unsigned long long u = 0;
+
+    for (int shift = 0; p < end && shift < 64; shift += 7)
+    {
+        unsigned char b = *p++;
+        u |= (unsigned long long)(b & 0x7f) << shift;
+        if (!(b & 0x80))
+        {
+            *pos = p;
+            *v = unzigzag(u);
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+static int put_varint(FILE *out, long long v)
+{
+    unsigned char buf[10];
+    unsigned long long u = zigzag(v);
+    int n = 0;
+
+    do
+    {
+        buf[n] = u & 0x7f;
+        u >>= 7;
+        if (u) buf[n] |= 0x80;
+        n++;
+    } while (u);
+
+    return fwrite(buf, 1, n, out) == (size_t)n ? 0 : -1;
+}
+
+static int open_binary(struct trace_reader *r, int fd)
+{
+    struct stat st;
+
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size < TRACE_HEADER_SIZE) return -1;
+
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED) return -1;
+    madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+    r->map = map;
+    r->map_size = st.st_size;
+
+    r->version = get_le(r->map + TRACE_MAGIC_LEN, 4);
+    if (r->version < 1 || r->version > TRACE_VERSION)
+    {
+        #ifdef DEBUG
+        fprintf(stderr, "unsupported trace version\n");
+        #endif
+        munmap(map, st.st_size);
+        r->map = NULL;
+        return -1;
+    }
+
+    r->format = TRACE_BINARY;
+    r->nr_events = get_le(r->map + 16, 8);
+    r->pos = r->map + TRACE_HEADER_SIZE;
+    r->end = r->map + r->map_size;
+    return 0;
+}
+
+int trace_open(struct trace_reader *r, const char *path)
+{
+    char magic[TRACE_MAGIC_LEN];
+
+    memset(r, 0, sizeof(*r));
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return -1;
+
+    if (read(fd, magic, TRACE_MAGIC_LEN) == TRACE_MAGIC_LEN && memcmp(magic, TRACE_MAGIC, TRACE_MAGIC_LEN) == 0)
+    {
+        int ret = open_binary(r, fd);
+        close(fd);  // the mapping outlives the descriptor
+        return ret;
+    }
+
+    r->format = TRACE_TEXT;
+    if (lseek(fd, 0, SEEK_SET) < 0 || !(r->fin = fdopen(fd, "r")))
+    {
+        close(fd);
+        return -1;
+    }
+
+    return 0;
+}
+
+int trace_read_columns(FILE *fin, long long *cols, int max)
+{
+    int n = 0;
+
+    while (n < max)
+    {
+        int c;
+        do c = getc(fin); while (c == ' ' || c == '\t');
+        ungetc(c, fin);
+
+        if (!((c >= '0' && c <= '9') || c == '-' || c == '+')) break;
+        if (fscanf(fin, "%lld", &cols[n]) != 1) break;
+        n++;
+    }
+
+    return n;
+}
+
+// same as trace_read_columns, on the rest of a line already read
+static int line_columns(const char *p, long long *cols, int max)
+{
+    int n = 0;
+
+    while (n < max)
+    {
+        char *end;
+        long long v = strtoll(p, &end, 10);
+
+        if (end == p) break;
+        cols[n++] = v;
+        p = end;
+    }
+
+    return n;
+}
+
+int trace_next(struct trace_reader *r, struct input *in)
+{
+    if (r->format == TRACE_TEXT)
+    {
+        char line[TRACE_LINE_MAX];
+        char action[128];
+        long long cols[2] = {0, 0};
+        int eof, used = 0;
+
+        // one event per line, so a bad line can't eat into the next one
+        do
+        {
+            if (!fgets(line, sizeof(line), r->fin)) return 0;
+            eof = sscanf(line, "%lld %127s %lld %lld%n", &in->time, action, &in->pid, &in->runtime, &used);
+        }
+        while (eof == EOF);     // blank line
+
+        // every action names a pid (or a group id)
+        if (eof < 3 || (!strchr(line, '\n') && !feof(r->fin)))
+        {
+            #ifdef DEBUG
+            fprintf(stderr, "malformed trace line: %s\n", line);
+            #endif
+            return -1;
+        }
+        if (in->time < 0)
+        {
+            #ifdef DEBUG
+            fprintf(stderr, "negative event time %lld\n", in->time);
+            #endif
+            return -1;
+        }
+        in->action = trace_action_parse(action);
+        if (eof < 4) in->runtime = 0;   // a SLEEP without a duration is untimed, whatever came before
+        if (eof == 4) line_columns(line + used, cols, in->action == TRACE_START ? 2 : 1);
+        in->nice = in->action == TRACE_START ? (int)cols[0] : 0;
+        in->group = in->action == TRACE_START ? cols[1] : in->action == TRACE_GROUP ? cols[0] : 0;
+        return 1;
+    }
+
+    if (r->pos >= r->end) return 0;
+
+    const unsigned char *p = r->pos;
+    unsigned char action = *p++;
+    long long delta, pid, runtime;
+    long long nice = 0;
+    long long group = 0;
+
+    if (action >= TRACE_NR_ACTIONS ||
+        !get_varint(&p, r->end, &delta) ||
+        !get_varint(&p, r->end, &pid) ||
+        !get_varint(&p, r->end, &runtime) ||
+        (action == TRACE_START && r->version >= 2 && !get_varint(&p, r->end, &nice)) ||
+        (action == TRACE_START && r->version >= 3 && !get_varint(&p, r->end, &group)) ||
+        (action == TRACE_GROUP && (r->version < 3 || !get_varint(&p, r->end, &group))))
+    {
+        #ifdef DEBUG
+        fprintf(stderr, "corrupt trace record at offset %zu\n", (size_t)(r->pos - r->map));
+        #endif
+        r->pos = r->end;
+        return -1;
+    }
+
+    // added unsigned, so a corrupt delta cannot overflow
+    long long time = (long long)((unsigned long long)r->last_time + (unsigned long long)delta);
+    if (time < 0)
+    {
+        #ifdef DEBUG
+        fprintf(stderr, "negative event time at offset %zu\n", (size_t)(r->pos - r->map));
+        #endif
+        r->pos = r->end;
+        return -1;
+    }
+
+    r->pos = p;
+    r->last_time = time;
+
+    in->time = r->last_time;
+    in->pid = pid;
+    in->runtime = runtime;
+    in->action = action;
+    in->nice = nice;
+    in->group = group;
+    return 1;
+}
+
+int trace_tell(struct trace_reader *r, struct trace_pos *pos)
+{
+    if (r->format == TRACE_TEXT)
+    {
+        pos->offset = ftell(r->fin);
+        pos->last_time = 0;
+        return pos->offset < 0 ? -1 : 0;
+    }
+
+    pos->offset = r->pos - r->map;
+    pos->last_time = r->last_time;
+    return 0;
+}
+
+int trace_seek(struct trace_reader *r, const struct trace_pos *pos)
+{
+    if (r->format == TRACE_TEXT) return fseek(r->fin, pos->offset, SEEK_SET);
+
+    if (pos->offset < TRACE_HEADER_SIZE || pos->offset > r->end - r->map) return -1;
+    r->pos = r->map + pos->offset;
+    r->last_time = pos->last_time;
+    return 0;
+}
+
+void trace_close(struct trace_reader *r)
+{
+    if (r->fin) fclose(r->fin);
+    if (r->map) munmap((void *)r->map, r->map_size);
+    memset(r, 0, sizeof(*r));
+}
+
+static int write_header(struct trace_writer *w)
+{
+    unsigned char header[TRACE_HEADER_SIZE] = {0};
+
+    memcpy(header, TRACE_MAGIC, TRACE_MAGIC_LEN);
+    put_le(header + TRACE_MAGIC_LEN, TRACE_VERSION, 4);
+    put_le(header + 16, w->nr_events, 8);
+
+    return fwrite(header, 1, sizeof(header), w->out) == sizeof(header) ? 0 : -1;
+}
+
+int trace_writer_open(struct trace_writer *w, FILE *out)
+{
+    w->out = out;
+    w->nr_events = 0;
+    w->last_time = 0;
+
+    return write_header(w);
+}
+
+int trace_write(struct trace_writer *w, long long time, int action, long long pid, long long runtime, int nice, long long group)
+{
+    unsigned char code = action;
+
+    if (fwrite(&code, 1, 1, w->out) != 1 ||
+        put_varint(w->out, time - w->last_time) < 0 ||
+        put_varint(w->out, pid) < 0 ||
+        put_varint(w->out, runtime) < 0 ||
+        (action == TRACE_START && put_varint(w->out, nice) < 0) ||
+        ((action == TRACE_START || action == TRACE_GROUP) && put_varint(w->out, group) < 0))
+    {
+        return -1;
+    }
+
+    w->last_time = time;
+    w->nr_events++;
+    return 0;
+}
+
+// patches the event count into the header, out must be seekable for that
+int trace_writer_close(struct trace_writer *w)
+{
+    if (fflush(w->out) != 0) return -1;
+    if (fseek(w->out, 0, SEEK_SET) != 0) return 0;
+
+    int ret = write_header(w);
+    fseek(w->out, 0, SEEK_END);
+    return ret;
+}
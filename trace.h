@@ -0,0 +1,112 @@
+#ifndef _TRACE_H
+#define _TRACE_H
+#include <stdio.h>
+#include <stddef.h>
+
+enum trace_action
+{
+    TRACE_UNKNOWN = -1,
+    TRACE_START = 0,
+    TRACE_SLEEP,
+    TRACE_WAKEUP,
+    TRACE_EXIT,
+    TRACE_GROUP,
+    TRACE_NR_ACTIONS,
+};
+
+// one event, the action is parsed once when the event is read
+struct input 
+{
+    long long pid;
+    long long duration;
+    long long runtime;
+    enum trace_action action;
+    int nice;               // START only, -20..19, 0 when the trace has none
+    long long time;
+    long long group;        // START: group the task joins, GROUP: its parent, 0 = root
+};
+
+/*
+    Text trace: one "time ACTION pid runtime [nice [group]]" event per
+    line, the trailing columns are optional and only read for START.
+    "time GROUP id shares [parent]" creates task group id (> 0) under
+    parent, 0 being the root, before any START that names it.
+
+    Binary trace: a fixed header followed by one variable-length record per
+    event, all little-endian:
+
+        header   "CFSTRACE" | u32 version | u32 reserved | u64 nr_events
+        record   u8 action | varint time delta | varint pid | varint runtime
+                 [| varint nice, START records from version 2 on]
+                 [| varint group, START records from version 3 on]
+                 [| varint parent, GROUP records]
+
+    Varints are LEB128 of the zigzag-encoded value, and the time delta is
+    relative to the previous record, so a typical event takes 4-6 bytes.
+    Records are decoded straight out of an mmap of the file. Version 1
+    files are still read, their tasks are all nice 0, and neither they nor
+    version 2 files have groups.
+*/
+#define TRACE_MAGIC         "CFSTRACE"
+#define TRACE_MAGIC_LEN     8
+#define TRACE_VERSION       3
+#define TRACE_HEADER_SIZE   24
+#define TRACE_LINE_MAX      256             // text traces, newline included
+
+enum trace_format
+{
+    TRACE_TEXT = 0,
+    TRACE_BINARY,
+};
+
+struct trace_reader
+{
+    enum trace_format format;
+    FILE *fin;                      // TRACE_TEXT
+    const unsigned char *map;       // TRACE_BINARY: whole file
+    size_t map_size;
+    const unsigned char *pos;       // next record
+    const unsigned char *end;
+    unsigned long long nr_events;   // from the header
+    unsigned int version;
+    long long last_time;
+};
+
+// where the next event starts, for checkpoints
+struct trace_pos
+{
+    long long offset;
+    long long last_time;            // TRACE_BINARY: base of the next time delta
+};
+
+struct trace_writer
+{
+    FILE *out;
+    unsigned long long nr_events;
+    long long last_time;
+};
+
+extern const char *trace_action_names[TRACE_NR_ACTIONS];
+int trace_action_parse(const char *name);
+
+static inline const char *trace_action_name(enum trace_action action)
+{
+    return action >= 0 && action < TRACE_NR_ACTIONS ? trace_action_names[action] : "UNKNOWN";
+}
+
+// sniffs the format from the first bytes of path
+int trace_open(struct trace_reader *r, const char *path);
+// 1 with the next event in *in, 0 at the end of the trace, -1 on a corrupt record
+// (a text line without time, action and pid) or a negative time
+int trace_next(struct trace_reader *r, struct input *in);
+int trace_tell(struct trace_reader *r, struct trace_pos *pos);
+int trace_seek(struct trace_reader *r, const struct trace_pos *pos);
+// up to max optional integer columns left on the current text line
+int trace_read_columns(FILE *fin, long long *cols, int max);
+void trace_close(struct trace_reader *r);
+
+int trace_writer_open(struct trace_writer *w, FILE *out);
+int trace_write(struct trace_writer *w, long long time, int action, long long pid, long long runtime, int nice, long long group);
+int trace_writer_close(struct trace_writer *w);
+
+#endif
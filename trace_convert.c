@@ -0,0 +1,123 @@
+#include <stdio.h>
+#include <string.h>
+#include "trace.h"
+
+/*
+    Converts scheduler_input.txt style traces to the binary format read by
+    the simulator (see trace.h), or back to text with -d.
+*/
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s [-d] INPUT OUTPUT\n"
+                    "       text -> binary, or binary -> text with -d\n", prog);
+}
+
+static int to_binary(const char *in_path, const char *out_path)
+{
+    FILE *fin = fopen(in_path, "r");
+    if (!fin)
+    {
+        perror(in_path);
+        return -1;
+    }
+
+    FILE *out = fopen(out_path, "wb");
+    if (!out)
+    {
+        perror(out_path);
+        fclose(fin);
+        return -1;
+    }
+
+    struct trace_writer w;
+    struct input in;
+    long long line = 0;
+    int ret = trace_writer_open(&w, out);
+
+    char name[128];
+
+    while (ret == 0 && fscanf(fin, "%lld %127s %lld %lld", &in.time, name, &in.pid, &in.runtime) == 4)
+    {
+        line++;
+        int action = trace_action_parse(name);
+        if (action < 0)
+        {
+            fprintf(stderr, "%s: event %lld: unknown action %s\n", in_path, line, name);
+            ret = -1;
+            break;
+        }
+
+        // optional nice / group / parent columns, see trace.h
+        long long cols[2] = {0, 0};
+        trace_read_columns(fin, cols, action == TRACE_START ? 2 : 1);
+        in.nice = action == TRACE_START ? (int)cols[0] : 0;
+        in.group = action == TRACE_START ? cols[1] : action == TRACE_GROUP ? cols[0] : 0;
+
+        ret = trace_write(&w, in.time, action, in.pid, in.runtime, in.nice, in.group);
+    }
+
+    if (ret == 0 && !feof(fin))
+    {
+        fprintf(stderr, "%s: malformed event after %lld events\n", in_path, line);
+        ret = -1;
+    }
+
+    if (ret == 0) ret = trace_writer_close(&w);
+    if (fclose(out) != 0) ret = -1;
+    fclose(fin);
+
+    if (ret == 0) fprintf(stderr, "%lld events\n", line);
+    return ret;
+}
+
+static int to_text(const char *in_path, const char *out_path)
+{
+    struct trace_reader r;
+
+    if (trace_open(&r, in_path) < 0 || r.format != TRACE_BINARY)
+    {
+        fprintf(stderr, "%s: not a binary trace\n", in_path);
+        trace_close(&r);
+        return -1;
+    }
+
+    FILE *out = fopen(out_path, "w");
+    if (!out)
+    {
+        perror(out_path);
+        trace_close(&r);
+        return -1;
+    }
+
+    struct input in;
+    int ret;
+    while ((ret = trace_next(&r, &in)) > 0)
+    {
+        fprintf(out, "%lld %s %lld %lld", in.time, trace_action_name(in.action), in.pid, in.runtime);
+        if (in.nice || (in.action == TRACE_START && in.group)) fprintf(out, " %d", in.nice);
+        if (in.group) fprintf(out, " %lld", in.group);
+        fputc('\n', out);
+    }
+
+    if (ret < 0) fprintf(stderr, "%s: corrupt record\n", in_path);
+    if (fclose(out) != 0) ret = -1;
+    trace_close(&r);
+    return ret;
+}
+
+int main(int argc, char **argv)
+{
+    int decode = argc > 1 && strcmp(argv[1], "-d") == 0;
+
+    if (argc != 3 + decode)
+    {
+        usage(argv[0]);
+        return -1;
+    }
+
+    const char *in_path = argv[1 + decode];
+    const char *out_path = argv[2 + decode];
+
+    return (decode ? to_text(in_path, out_path) : to_binary(in_path, out_path)) < 0 ? -1 : 0;
+}
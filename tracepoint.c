@@ -0,0 +1,107 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "tracepoint.h"
+
+#ifndef NO_TRACEPOINTS
+_Thread_local struct tp_ring *tp_ring_current;
+#endif
+
+static const struct
+{
+    const char *name;
+    const char *a;
+    const char *b;
+} tp_info[TP_NR_POINTS] = {
+    [TP_ENQUEUE]  = { "enqueue",  "vruntime", "nr_running" },
+    [TP_DEQUEUE]  = { "dequeue",  "vruntime", "nr_running" },
+    [TP_PICK]     = { "pick",     "cpu",      "slice" },
+    [TP_SLEEP]    = { "sleep",    "cpu",      "remaining" },
+    [TP_WAKE]     = { "wake",     "cpu",      "vruntime" },
+    [TP_EXIT]     = { "exit",     "cpu",      "remaining" },
+    [TP_MIGRATE]  = { "migrate",  "src",      "dst" },
+    [TP_REHASH]   = { "rehash",   "old",      "new" },
+    [TP_ROTATION] = { "rotation", "right",    NULL },
+};
+
+// comma separated point names or "all"
+int tp_parse_mask(const char *list, unsigned int *mask)
+{
+    *mask = 0;
+
+    while (*list)
+    {
+        size_t len = strcspn(list, ",");
+        int found = 0;
+
+        if (len == 3 && strncmp(list, "all", 3) == 0)
+        {
+            *mask |= TP_ALL;
+            found = 1;
+        }
+        for (int i = 0; i < TP_NR_POINTS && !found; i++)
+        {
+            if (strlen(tp_info[i].name) == len && strncmp(list, tp_info[i].name, len) == 0)
+            {
+                *mask |= 1u << i;
+                found = 1;
+            }
+        }
+        if (!found) return -1;
+
+        list += len;
+        if (*list == ',') list++;
+    }
+
+    return *mask ? 0 : -1;
+}
+
+int tp_ring_init(struct tp_ring *r, unsigned int enabled, size_t size, const size_t *clock)
+{
+    size_t entries = 1;
+    while (entries < size) entries <<= 1;
+
+    memset(r, 0, sizeof(*r));
+    if (!enabled) return 0;
+
+    r->entries = calloc(entries, sizeof(struct tp_entry));
+    if (!r->entries)
+    {
+        #ifdef DEBUG
+        fprintf(stderr, "tracepoint ring alloc failed\n");
+        #endif
+        return -1;
+    }
+
+    r->enabled = enabled;
+    r->clock = clock;
+    r->mask = entries - 1;
+    return 0;
+}
+
+void tp_ring_destroy(struct tp_ring *r)
+{
+    free(r->entries);
+    memset(r, 0, sizeof(*r));
+}
+
+// oldest surviving entry first
+void tp_ring_dump(struct tp_ring *r, FILE *out)
+{
+    if (!r->entries) return;
+
+    size_t size = r->mask + 1;
+    unsigned long long first = r->head > size ? r->head - size : 0;
+
+    fprintf(out, "tracepoints: %llu recorded, %llu overwritten\n", r->head, first);
+
+    for (unsigned long long i = first; i < r->head; i++)
+    {
+        struct tp_entry *e = &r->entries[i & r->mask];
+
+        fprintf(out, "[TIME %lld] tp %s pid=%lld %s=%lld", e->time, tp_info[e->point].name,
+            e->pid, tp_info[e->point].a, e->a);
+        if (tp_info[e->point].b) fprintf(out, " %s=%lld", tp_info[e->point].b, e->b);
+        fputc('\n', out);
+    }
+}
@@ -0,0 +1,85 @@
+#ifndef _TRACEPOINT_H
+#define _TRACEPOINT_H
+#include <stdio.h>
+#include <stddef.h>
+
+/*
+    Named tracepoints recorded into a per-run ring buffer.
+
+    A disabled point is one predicted-not-taken branch on a thread-local
+    pointer and mask; building with -DNO_TRACEPOINTS removes them
+    altogether. The ring of the running simulation is published through
+    tp_ring_current (see sched_run), so leaf modules (avl, rbtree, map)
+    can fire points without a context argument, and simulations on
+    different threads never share a ring. When the ring is full the
+    oldest entries are overwritten.
+*/
+enum tp_point
+{
+    TP_ENQUEUE = 0,     // pid, vruntime, nr_running after
+    TP_DEQUEUE,         // pid, vruntime, nr_running after
+    TP_PICK,            // pid, cpu, slice
+    TP_SLEEP,           // pid, cpu, remaining
+    TP_WAKE,            // pid, cpu, vruntime
+    TP_EXIT,            // pid, cpu, remaining
+    TP_MIGRATE,         // pid, src cpu, dst cpu
+    TP_REHASH,          // -, old slots, new slots
+    TP_ROTATION,        // pid of the subtree root, 0 left / 1 right, -
+    TP_NR_POINTS,
+};
+
+#define TP_ALL              ((1u << TP_NR_POINTS) - 1)
+#define TP_DEFAULT_SIZE     4096
+
+struct tp_entry
+{
+    long long time;
+    long long pid;
+    long long a;
+    long long b;
+    int point;
+};
+
+struct tp_ring
+{
+    unsigned int enabled;           // bit per enum tp_point
+    const size_t *clock;            // sim_time of the run
+    struct tp_entry *entries;
+    size_t mask;                    // size - 1, size is a power of two
+    unsigned long long head;        // entries ever recorded
+};
+
+#ifdef NO_TRACEPOINTS
+
+#define tp_fire(point, pid, a, b)   do { } while (0)
+
+#else
+
+extern _Thread_local struct tp_ring *tp_ring_current;
+
+static inline void tp_record(struct tp_ring *r, int point, long long pid, long long a, long long b)
+{
+    struct tp_entry *e = &r->entries[r->head++ & r->mask];
+
+    e->time = r->clock ? (long long)*r->clock : 0;
+    e->pid = pid;
+    e->a = a;
+    e->b = b;
+    e->point = point;
+}
+
+#define tp_fire(point, pid, a, b)                                               \
+    do {                                                                        \
+        struct tp_ring *__tp = tp_ring_current;                                 \
+        if (__builtin_expect(__tp != NULL && (__tp->enabled >> (point)) & 1, 0)) \
+            tp_record(__tp, (point), (pid), (a), (b));                          \
+    } while (0)
+
+#endif
+
+int tp_parse_mask(const char *list, unsigned int *mask);
+int tp_ring_init(struct tp_ring *r, unsigned int enabled, size_t size, const size_t *clock);
+void tp_ring_destroy(struct tp_ring *r);
+void tp_ring_dump(struct tp_ring *r, FILE *out);
+
+#endif
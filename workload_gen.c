@@ -0,0 +1,360 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "trace.h"
+
+/*
+    Seeded synthetic workload generator. The same seed and options always
+    give the same trace.
+
+    Tasks arrive as a Poisson process, optionally in bursts that share one
+    timestamp, with Pareto (heavy-tailed) runtimes. After starting, a task
+    goes through sleep/wake cycles with probability -sleep each, some of
+    its sleeps are never woken (-orphan) and some tasks are killed by an
+    EXIT before their runtime is used up (-exit). With -timed a share of
+    the sleeps carry their duration (SLEEP pid ms) and wake on their own,
+    without a WAKEUP event. With -nice a share of the
+    tasks get a random nice level instead of 0. With -groups N the trace
+    opens with N task groups nested at random under each other and the root,
+    and every task joins one of them or the root. Per-task events are kept
+    in a min-heap, so memory only grows with the number of live tasks and
+    the trace is streamed out in time order.
+
+    gcc -O2 -o workload_gen workload_gen.c trace.c -lm
+    ./workload_gen -tasks 1000000 -seed 7 -binary -o trace.bin
+*/
+
+struct gen_config
+{
+    unsigned long long seed;
+    long long nr_tasks;
+    double arrival_gap;     // mean ms between arrivals
+    double burst_prob;      // chance an arrival is a burst
+    int burst_size;         // max tasks in a burst
+    double pareto_alpha;
+    double min_runtime;
+    long long max_runtime;
+    double sleep_prob;      // chance of another sleep/wake cycle
+    double event_gap;       // mean ms between a task's own events
+    double sleep_time;      // mean ms asleep
+    double orphan_prob;     // chance a sleep is never woken
+    double timed_prob;      // chance a woken sleep is a timed one
+    double exit_prob;       // chance a task is killed by EXIT
+    double nice_prob;       // chance a task gets a nonzero nice level
+    int nr_groups;
+    int binary;
+    const char *output;
+};
+
+struct gen_event
+{
+    long long time;
+    unsigned long long seq;     // ties keep generation order
+    long long pid;
+    int action;
+    int sleeps_left;
+    int killed;             // ends with an EXIT event
+};
+
+struct gen_heap
+{
+    struct gen_event *ev;
+    size_t size;
+    size_t cap;
+};
+
+static unsigned long long rng_state;
+
+// splitmix64, good enough and identical on every platform
+static unsigned long long rng_next(void)
+{
+    unsigned long long z = (rng_state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+// uniform in (0, 1]
+static double rng_unit(void)
+{
+    return ((rng_next() >> 11) + 1) * (1.0 / 9007199254740992.0);
+}
+
+static long long rng_exp(double mean)
+{
+    return (long long)(-mean * log(rng_unit()));
+}
+
+static long long rng_pareto(double xm, double alpha, long long cap)
+{
+    double v = xm / pow(rng_unit(), 1.0 / alpha);
+    return v > cap ? cap : (long long)v;
+}
+
+static int event_less(const struct gen_event *a, const struct gen_event *b)
+{
+    return a->time < b->time || (a->time == b->time && a->seq < b->seq);
+}
+
+static void heap_push(struct gen_heap *h, struct gen_event ev)
+{
+    if (h->size == h->cap)
+    {
+        h->cap = h->cap ? h->cap * 2 : 1024;
+        h->ev = realloc(h->ev, h->cap * sizeof(struct gen_event));
+        if (!h->ev)
+        {
+            fprintf(stderr, "out of memory\n");
+            exit(1);
+        }
+    }
+
+    size_t i = h->size++;
+    while (i > 0)
+    {
+        size_t parent = (i - 1) / 2;
+        if (!event_less(&ev, &h->ev[parent])) break;
+        h->ev[i] = h->ev[parent];
+        i = parent;
+    }
+    h->ev[i] = ev;
+}
+
+static struct gen_event heap_pop(struct gen_heap *h)
+{
+    struct gen_event top = h->ev[0];
+    struct gen_event last = h->ev[--h->size];
+    size_t i = 0;
+
+    for (;;)
+    {
+        size_t child = 2 * i + 1;
+        if (child >= h->size) break;
+        if (child + 1 < h->size && event_less(&h->ev[child + 1], &h->ev[child])) child++;
+        if (!event_less(&h->ev[child], &last)) break;
+        h->ev[i] = h->ev[child];
+        i = child;
+    }
+    if (h->size) h->ev[i] = last;
+
+    return top;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+        "usage: %s [-seed N] [-tasks N] [-o FILE] [-binary]\n"
+        "          [-arrival MS] [-burst P] [-burst-size N]\n"
+        "          [-alpha A] [-min-runtime MS] [-max-runtime MS]\n"
+        "          [-sleep P] [-gap MS] [-sleep-time MS] [-orphan P] [-exit P] [-nice P]\n"
+        "          [-timed P] [-groups N]\n", prog);
+}
+
+static int parse_args(struct gen_config *cfg, int argc, char **argv)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        const char *opt = argv[i];
+
+        if (strcmp(opt, "-binary") == 0)
+        {
+            cfg->binary = 1;
+            continue;
+        }
+        if (i + 1 >= argc) return -1;
+
+        const char *arg = argv[++i];
+        if (strcmp(opt, "-seed") == 0) cfg->seed = strtoull(arg, NULL, 0);
+        else if (strcmp(opt, "-tasks") == 0) cfg->nr_tasks = atoll(arg);
+        else if (strcmp(opt, "-o") == 0) cfg->output = arg;
+        else if (strcmp(opt, "-arrival") == 0) cfg->arrival_gap = atof(arg);
+        else if (strcmp(opt, "-burst") == 0) cfg->burst_prob = atof(arg);
+        else if (strcmp(opt, "-burst-size") == 0) cfg->burst_size = atoi(arg);
+        else if (strcmp(opt, "-alpha") == 0) cfg->pareto_alpha = atof(arg);
+        else if (strcmp(opt, "-min-runtime") == 0) cfg->min_runtime = atof(arg);
+        else if (strcmp(opt, "-max-runtime") == 0) cfg->max_runtime = atoll(arg);
+        else if (strcmp(opt, "-sleep") == 0) cfg->sleep_prob = atof(arg);
+        else if (strcmp(opt, "-gap") == 0) cfg->event_gap = atof(arg);
+        else if (strcmp(opt, "-sleep-time") == 0) cfg->sleep_time = atof(arg);
+        else if (strcmp(opt, "-orphan") == 0) cfg->orphan_prob = atof(arg);
+        else if (strcmp(opt, "-timed") == 0) cfg->timed_prob = atof(arg);
+        else if (strcmp(opt, "-exit") == 0) cfg->exit_prob = atof(arg);
+        else if (strcmp(opt, "-nice") == 0) cfg->nice_prob = atof(arg);
+        else if (strcmp(opt, "-groups") == 0) cfg->nr_groups = atoi(arg);
+        else return -1;
+    }
+
+    if (cfg->nr_tasks < 0 || cfg->nr_groups < 0 || cfg->burst_size < 1 || cfg->pareto_alpha <= 0 ||
+        cfg->min_runtime < 1 || cfg->max_runtime < 1 || cfg->sleep_prob >= 1.0)
+    {
+        return -1;
+    }
+
+    return 0;
+}
+
+struct gen_output
+{
+    FILE *out;
+    int binary;
+    struct trace_writer w;
+    unsigned long long counts[TRACE_NR_ACTIONS];
+};
+
+static int emit(struct gen_output *o, long long time, int action, long long pid, long long runtime,
+    int nice, long long group)
+{
+    o->counts[action]++;
+
+    if (o->binary) return trace_write(&o->w, time, action, pid, runtime, nice, group);
+    if (action == TRACE_GROUP && group) return fprintf(o->out, "%lld GROUP %lld %lld %lld\n", time, pid, runtime, group) < 0 ? -1 : 0;
+    if (group) return fprintf(o->out, "%lld %s %lld %lld %d %lld\n", time, trace_action_names[action], pid, runtime, nice, group) < 0 ? -1 : 0;
+    if (nice) return fprintf(o->out, "%lld %s %lld %lld %d\n", time, trace_action_names[action], pid, runtime, nice) < 0 ? -1 : 0;
+    return fprintf(o->out, "%lld %s %lld %lld\n", time, trace_action_names[action], pid, runtime) < 0 ? -1 : 0;
+}
+
+// next event of a task that has just started or woken at time now
+static void schedule_task(struct gen_config *cfg, struct gen_heap *h, unsigned long long *seq,
+    long long pid, long long now, int sleeps_left, int killed)
+{
+    struct gen_event ev = { .pid = pid, .sleeps_left = sleeps_left, .killed = killed };
+
+    ev.time = now + 1 + rng_exp(cfg->event_gap);
+    ev.seq = (*seq)++;
+
+    if (sleeps_left > 0) ev.action = TRACE_SLEEP;
+    else if (killed) ev.action = TRACE_EXIT;
+    else return;    // runs until its runtime is used up
+
+    heap_push(h, ev);
+}
+
+static int generate(struct gen_config *cfg, struct gen_output *o)
+{
+    struct gen_heap heap = {0};
+    unsigned long long seq = 0;
+    long long next_pid = 1;
+    long long next_arrival = 0;
+    long long started = 0;
+    int ret = 0;
+
+    rng_state = cfg->seed;
+
+    // group g hangs off the root or an earlier group
+    for (int g = 1; g <= cfg->nr_groups && ret == 0; g++)
+    {
+        long long shares = 256LL << (rng_next() % 5);
+        ret = emit(o, 0, TRACE_GROUP, g, shares, 0, rng_next() % g);
+    }
+
+    while (ret == 0 && (started < cfg->nr_tasks || heap.size))
+    {
+        if (started < cfg->nr_tasks && (!heap.size || next_arrival <= heap.ev[0].time))
+        {
+            int burst = rng_unit() < cfg->burst_prob ? 1 + (int)(rng_next() % cfg->burst_size) : 1;
+
+            for (int b = 0; b < burst && started < cfg->nr_tasks && ret == 0; b++, started++)
+            {
+                long long pid = next_pid++;
+                long long runtime = rng_pareto(cfg->min_runtime, cfg->pareto_alpha, cfg->max_runtime);
+
+                int sleeps = 0;
+                while (rng_unit() < cfg->sleep_prob) sleeps++;
+                int killed = rng_unit() < cfg->exit_prob;
+
+                // only draws when enabled, so -nice 0 traces match older ones
+                int nice = 0;
+                if (cfg->nice_prob > 0 && rng_unit() < cfg->nice_prob) nice = (int)(rng_next() % 40) - 20;
+
+                long long group = cfg->nr_groups > 0 ? (long long)(rng_next() % (cfg->nr_groups + 1)) : 0;
+
+                ret = emit(o, next_arrival, TRACE_START, pid, runtime, nice, group);
+                schedule_task(cfg, &heap, &seq, pid, next_arrival, sleeps, killed);
+            }
+
+            next_arrival += rng_exp(cfg->arrival_gap);
+            continue;
+        }
+
+        struct gen_event ev = heap_pop(&heap);
+
+        if (ev.action == TRACE_SLEEP && rng_unit() >= cfg->orphan_prob)
+        {
+            struct gen_event wake = ev;
+            wake.action = TRACE_WAKEUP;
+            wake.time = ev.time + 1 + rng_exp(cfg->sleep_time);
+
+            // only draws when enabled, so -timed 0 traces match older ones
+            if (cfg->timed_prob > 0 && rng_unit() < cfg->timed_prob)
+            {
+                ret = emit(o, ev.time, TRACE_SLEEP, ev.pid, wake.time - ev.time, 0, 0);
+                schedule_task(cfg, &heap, &seq, ev.pid, wake.time, ev.sleeps_left - 1, ev.killed);
+                continue;
+            }
+
+            ret = emit(o, ev.time, ev.action, ev.pid, 0, 0, 0);
+            wake.seq = seq++;
+            heap_push(&heap, wake);
+            continue;
+        }
+
+        ret = emit(o, ev.time, ev.action, ev.pid, 0, 0, 0);
+        if (ev.action == TRACE_WAKEUP)
+        {
+            schedule_task(cfg, &heap, &seq, ev.pid, ev.time, ev.sleeps_left - 1, ev.killed);
+        }
+    }
+
+    free(heap.ev);
+    return ret;
+}
+
+int main(int argc, char **argv)
+{
+    struct gen_config cfg = {
+        .seed = 1,
+        .nr_tasks = 1000,
+        .arrival_gap = 20.0,
+        .burst_prob = 0.05,
+        .burst_size = 32,
+        .pareto_alpha = 1.5,
+        .min_runtime = 5,
+        .max_runtime = 10000,
+        .sleep_prob = 0.5,
+        .event_gap = 10.0,
+        .sleep_time = 20.0,
+        .orphan_prob = 0.01,
+        .exit_prob = 0.1,
+    };
+
+    if (parse_args(&cfg, argc, argv) < 0)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    struct gen_output o = { .binary = cfg.binary };
+    o.out = cfg.output ? fopen(cfg.output, cfg.binary ? "wb" : "w") : stdout;
+    if (!o.out)
+    {
+        perror(cfg.output);
+        return 1;
+    }
+
+    int ret = o.binary ? trace_writer_open(&o.w, o.out) : 0;
+    if (ret == 0) ret = generate(&cfg, &o);
+    if (ret == 0 && o.binary) ret = trace_writer_close(&o.w);
+    if (o.out != stdout && fclose(o.out) != 0) ret = -1;
+
+    if (ret < 0)
+    {
+        fprintf(stderr, "write failed\n");
+        return 1;
+    }
+
+    fprintf(stderr, "seed %llu: %llu START, %llu SLEEP, %llu WAKEUP, %llu EXIT, %llu GROUP\n", cfg.seed,
+        o.counts[TRACE_START], o.counts[TRACE_SLEEP], o.counts[TRACE_WAKEUP], o.counts[TRACE_EXIT],
+        o.counts[TRACE_GROUP]);
+    return 0;
+}